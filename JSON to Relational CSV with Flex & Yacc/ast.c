@@ -1,103 +1,360 @@
 #include "ast.h"
+#include "stats.h"
+#include "mem.h"
+#include <pthread.h>
 
-/* Create a new JSON object node */
-JsonValue* create_object(int line, int column) {
-    JsonValue *obj = (JsonValue*)malloc(sizeof(JsonValue));
-    if (!obj) {
-        fprintf(stderr, "Memory allocation failed for JSON object\n");
+/* Record source positions of new nodes (--positions) */
+int json_track_positions = 0;
+
+/* Position table: node address -> line and column, open addressing with
+ * linear probing. Batch workers build documents at the same time, so the
+ * table is shared under a lock; it is only used with --positions. */
+typedef struct PositionEntry {
+    const JsonValue *node;
+    int line;
+    int column;
+} PositionEntry;
+
+static PositionEntry *position_table = NULL;
+static size_t position_capacity = 0;
+static size_t position_count = 0;
+static pthread_mutex_t position_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t position_home(const JsonValue *node) {
+    uint64_t hash = (uint64_t)(uintptr_t)node * 0x9e3779b97f4a7c15ULL;
+    return (size_t)(hash >> 32) & (position_capacity - 1);
+}
+
+/* Slot holding node, or the empty slot where it would go */
+static size_t position_find(const JsonValue *node) {
+    size_t slot = position_home(node);
+    while (position_table[slot].node && position_table[slot].node != node) {
+        slot = (slot + 1) & (position_capacity - 1);
+    }
+    return slot;
+}
+
+/* Insert or replace node's entry; caller holds position_lock */
+static void position_insert(const JsonValue *node, int line, int column) {
+    if ((position_count + 1) * 2 > position_capacity) {
+        PositionEntry *old_table = position_table;
+        size_t old_capacity = position_capacity;
+        position_capacity = position_capacity ? position_capacity * 2 : 1024;
+        position_table = (PositionEntry*)mem_calloc(MEM_AST, position_capacity, sizeof(PositionEntry));
+        if (!position_table) {
+            fprintf(stderr, "Memory allocation failed for position table\n");
+            exit(1);
+        }
+        for (size_t i = 0; i < old_capacity; i++) {
+            if (old_table[i].node) {
+                position_table[position_find(old_table[i].node)] = old_table[i];
+            }
+        }
+        mem_free(MEM_AST, old_table);
+    }
+
+    size_t slot = position_find(node);
+    if (!position_table[slot].node) {
+        position_count++;
+    }
+    position_table[slot].node = node;
+    position_table[slot].line = line;
+    position_table[slot].column = column;
+}
+
+/* Remove node's entry, shifting later entries of its probe run back so
+ * lookups never stop at the hole; caller holds position_lock */
+static int position_remove(const JsonValue *node, int *line, int *column) {
+    size_t hole = position_find(node);
+    if (!position_table[hole].node) {
+        return 0;
+    }
+    *line = position_table[hole].line;
+    *column = position_table[hole].column;
+    position_count--;
+
+    size_t mask = position_capacity - 1;
+    size_t next = hole;
+    for (;;) {
+        position_table[hole].node = NULL;
+        for (;;) {
+            next = (next + 1) & mask;
+            if (!position_table[next].node) {
+                return 1;
+            }
+            /* The entry may fill the hole unless its home lies in (hole, next] */
+            size_t home = position_home(position_table[next].node);
+            if (((next - home) & mask) >= ((next - hole) & mask)) {
+                break;
+            }
+        }
+        position_table[hole] = position_table[next];
+        hole = next;
+    }
+}
+
+static void record_position(JsonValue *node, int line, int column) {
+    pthread_mutex_lock(&position_lock);
+    position_insert(node, line, column);
+    pthread_mutex_unlock(&position_lock);
+    node->flags |= JSON_HAS_POSITION;
+}
+
+/* Re-key a position after its node was copied from "from" to "to" */
+static void move_position(const JsonValue *from, const JsonValue *to) {
+    int line, column;
+    pthread_mutex_lock(&position_lock);
+    if (position_remove(from, &line, &column)) {
+        position_insert(to, line, column);
+    }
+    pthread_mutex_unlock(&position_lock);
+}
+
+static void forget_position(const JsonValue *node) {
+    int line, column;
+    pthread_mutex_lock(&position_lock);
+    position_remove(node, &line, &column);
+    if (position_count == 0) {
+        /* The last document was freed */
+        mem_free(MEM_AST, position_table);
+        position_table = NULL;
+        position_capacity = 0;
+    }
+    pthread_mutex_unlock(&position_lock);
+}
+
+/* Line and column a node was parsed at */
+int json_value_position(const JsonValue *value, int *line, int *column) {
+    if (!(value->flags & JSON_HAS_POSITION)) {
+        return 0;
+    }
+    pthread_mutex_lock(&position_lock);
+    size_t slot = position_find(value);
+    int found = position_table[slot].node != NULL;
+    if (found) {
+        *line = position_table[slot].line;
+        *column = position_table[slot].column;
+    }
+    pthread_mutex_unlock(&position_lock);
+    return found;
+}
+
+/* Allocate a standalone node: a document root or a predicate constant */
+JsonValue* new_json_value(void) {
+    JsonValue *node = (JsonValue*)mem_alloc(MEM_AST, sizeof(JsonValue));
+    if (!node) {
+        fprintf(stderr, "Memory allocation failed for JSON value\n");
         exit(1);
     }
     
-    obj->type = JSON_OBJECT;
-    obj->value.object_head = NULL;
-    obj->line = line;
-    obj->column = column;
+    run_stats.ast_bytes += sizeof(JsonValue);
+    node->type = JSON_NULL;
+    node->flags = 0;
+    return node;
+}
+
+/* Record where a node was parsed (--positions) */
+void set_json_position(JsonValue *node, int line, int column) {
+    if (json_track_positions) {
+        record_position(node, line, column);
+    }
+}
+
+static void init_node(JsonValue *node, JsonType type) {
+    run_stats.ast_nodes++;
+    node->type = type;
+    node->flags = 0;
+    node->value.object_head = NULL;
+}
+
+/* Initialize a node as an empty object */
+void init_object(JsonValue *node) {
+    init_node(node, JSON_OBJECT);
+}
+
+/* Initialize a node as an empty array */
+void init_array(JsonValue *node) {
+    init_node(node, JSON_ARRAY);
+}
+
+/* Store a string's text, inline when it is short. With owned set the
+ * node takes over (or frees) the caller's heap copy. */
+static void set_string(JsonValue *node, char *value, int owned) {
+    size_t length = strlen(value);
+    if (length <= JSON_INLINE_MAX) {
+        memcpy(node->inline_string, value, length + 1);
+        node->flags |= JSON_INLINE_STRING;
+        if (owned) {
+            mem_free(MEM_STRINGS, value);
+        }
+        return;
+    }
     
+    node->value.string_value = owned ? value : mem_strdup(MEM_STRINGS, value);
+    if (!node->value.string_value) {
+        fprintf(stderr, "Memory allocation failed for string value\n");
+        exit(1);
+    }
+    run_stats.ast_bytes += length + 1;
+}
+
+/* Initialize a node as a string, taking ownership of value */
+void init_string_owned(JsonValue *node, char *value) {
+    init_node(node, JSON_STRING);
+    set_string(node, value, 1);
+}
+
+/* Initialize a node as a string copied from value */
+void init_string(JsonValue *node, const char *value) {
+    init_node(node, JSON_STRING);
+    set_string(node, (char*)value, 0);
+}
+
+/* Initialize a node as a number */
+void init_number(JsonValue *node, double value) {
+    init_node(node, JSON_NUMBER);
+    node->value.number_value = value;
+}
+
+/* Initialize a node as a boolean */
+void init_boolean(JsonValue *node, int value) {
+    init_node(node, JSON_BOOLEAN);
+    node->value.boolean_value = value;
+}
+
+/* Initialize a node as null */
+void init_null(JsonValue *node) {
+    init_node(node, JSON_NULL);
+}
+
+/* Create a new JSON object node */
+JsonValue* create_object(int line, int column) {
+    JsonValue *obj = new_json_value();
+    init_object(obj);
+    set_json_position(obj, line, column);
     return obj;
 }
 
 /* Create a new JSON array node */
 JsonValue* create_array(int line, int column) {
-    JsonValue *arr = (JsonValue*)malloc(sizeof(JsonValue));
-    if (!arr) {
-        fprintf(stderr, "Memory allocation failed for JSON array\n");
-        exit(1);
-    }
-    
-    arr->type = JSON_ARRAY;
-    arr->value.array_head = NULL;
-    arr->line = line;
-    arr->column = column;
-    
+    JsonValue *arr = new_json_value();
+    init_array(arr);
+    set_json_position(arr, line, column);
     return arr;
 }
 
 /* Create a new JSON string node */
 JsonValue* create_string(char *value, int line, int column) {
-    JsonValue *str = (JsonValue*)malloc(sizeof(JsonValue));
-    if (!str) {
-        fprintf(stderr, "Memory allocation failed for JSON string\n");
-        exit(1);
-    }
-    
-    str->type = JSON_STRING;
-    str->value.string_value = strdup(value);
-    if (!str->value.string_value) {
-        fprintf(stderr, "Memory allocation failed for string value\n");
-        free(str);
-        exit(1);
-    }
-    str->line = line;
-    str->column = column;
-    
+    JsonValue *str = new_json_value();
+    init_node(str, JSON_STRING);
+    set_string(str, value, 0);
+    set_json_position(str, line, column);
+    return str;
+}
+
+/* Create a new JSON string node that takes ownership of value */
+JsonValue* create_string_owned(char *value, int line, int column) {
+    JsonValue *str = new_json_value();
+    init_string_owned(str, value);
+    set_json_position(str, line, column);
     return str;
 }
 
 /* Create a new JSON number node */
 JsonValue* create_number(double value, int line, int column) {
-    JsonValue *num = (JsonValue*)malloc(sizeof(JsonValue));
-    if (!num) {
-        fprintf(stderr, "Memory allocation failed for JSON number\n");
-        exit(1);
-    }
-    
-    num->type = JSON_NUMBER;
-    num->value.number_value = value;
-    num->line = line;
-    num->column = column;
-    
+    JsonValue *num = new_json_value();
+    init_number(num, value);
+    set_json_position(num, line, column);
     return num;
 }
 
 /* Create a new JSON boolean node */
 JsonValue* create_boolean(int value, int line, int column) {
-    JsonValue *boolean = (JsonValue*)malloc(sizeof(JsonValue));
-    if (!boolean) {
-        fprintf(stderr, "Memory allocation failed for JSON boolean\n");
+    JsonValue *boolean = new_json_value();
+    init_boolean(boolean, value);
+    set_json_position(boolean, line, column);
+    return boolean;
+}
+
+/* Create a new JSON null node */
+JsonValue* create_null(int line, int column) {
+    JsonValue *null_value = new_json_value();
+    init_null(null_value);
+    set_json_position(null_value, line, column);
+    return null_value;
+}
+
+/* Create an unlinked pair whose value is null until the caller fills it
+ * in place. A short key is stored in the pair; with owned set the pair
+ * takes over (or frees) the caller's heap copy. */
+static KeyValuePair* make_key_value(char *key, int owned) {
+    KeyValuePair *pair = (KeyValuePair*)mem_alloc(MEM_AST, sizeof(KeyValuePair));
+    if (!pair) {
+        fprintf(stderr, "Memory allocation failed for key-value pair\n");
         exit(1);
     }
     
-    boolean->type = JSON_BOOLEAN;
-    boolean->value.boolean_value = value;
-    boolean->line = line;
-    boolean->column = column;
+    size_t length = strlen(key);
+    if (length < sizeof(pair->short_key)) {
+        memcpy(pair->short_key, key, length + 1);
+        pair->key = pair->short_key;
+        if (owned) {
+            mem_free(MEM_STRINGS, key);
+        }
+    } else {
+        pair->key = owned ? key : mem_strdup(MEM_STRINGS, key);
+        if (!pair->key) {
+            fprintf(stderr, "Memory allocation failed for key\n");
+            exit(1);
+        }
+        run_stats.ast_bytes += length + 1;
+    }
     
-    return boolean;
+    pair->value.type = JSON_NULL;
+    pair->value.flags = 0;
+    pair->next = NULL;
+    run_stats.ast_links++;
+    run_stats.ast_bytes += sizeof(KeyValuePair);
+    
+    return pair;
 }
 
-/* Create a new JSON null node */
-JsonValue* create_null(int line, int column) {
-    JsonValue *null_val = (JsonValue*)malloc(sizeof(JsonValue));
-    if (!null_val) {
-        fprintf(stderr, "Memory allocation failed for JSON null\n");
+/* Create an unlinked pair, taking ownership of key */
+KeyValuePair* new_key_value(char *key) {
+    return make_key_value(key, 1);
+}
+
+/* Create an unlinked pair with a copy of key */
+KeyValuePair* new_key_value_copy(const char *key) {
+    return make_key_value((char*)key, 0);
+}
+
+/* Create an unlinked element whose value is null until the caller fills
+ * it in place */
+ArrayElement* new_array_element(void) {
+    ArrayElement *arr_elem = (ArrayElement*)mem_alloc(MEM_AST, sizeof(ArrayElement));
+    if (!arr_elem) {
+        fprintf(stderr, "Memory allocation failed for array element\n");
         exit(1);
     }
     
-    null_val->type = JSON_NULL;
-    null_val->line = line;
-    null_val->column = column;
+    arr_elem->value.type = JSON_NULL;
+    arr_elem->value.flags = 0;
+    arr_elem->next = NULL;
+    run_stats.ast_links++;
+    run_stats.ast_bytes += sizeof(ArrayElement);
     
-    return null_val;
+    return arr_elem;
+}
+
+/* Move a standalone node into a link's value and free the original */
+static void embed_value(JsonValue *member, JsonValue *value) {
+    *member = *value;
+    if (value->flags & JSON_HAS_POSITION) {
+        move_position(value, member);
+    }
+    mem_free(MEM_AST, value);
+    run_stats.ast_bytes -= sizeof(JsonValue);
 }
 
 /* Add a key-value pair to a JSON object */
@@ -107,21 +364,8 @@ void add_key_value(JsonValue *object, char *key, JsonValue *value) {
         exit(1);
     }
     
-    KeyValuePair *pair = (KeyValuePair*)malloc(sizeof(KeyValuePair));
-    if (!pair) {
-        fprintf(stderr, "Memory allocation failed for key-value pair\n");
-        exit(1);
-    }
-    
-    pair->key = strdup(key);
-    if (!pair->key) {
-        fprintf(stderr, "Memory allocation failed for key\n");
-        free(pair);
-        exit(1);
-    }
-    
-    pair->value = value;
-    pair->next = NULL;
+    KeyValuePair *pair = new_key_value_copy(key);
+    embed_value(&pair->value, value);
     
     /* Add to the end of the list to maintain order */
     if (object->value.object_head == NULL) {
@@ -142,14 +386,8 @@ void add_array_element(JsonValue *array, JsonValue *element) {
         exit(1);
     }
     
-    ArrayElement *arr_elem = (ArrayElement*)malloc(sizeof(ArrayElement));
-    if (!arr_elem) {
-        fprintf(stderr, "Memory allocation failed for array element\n");
-        exit(1);
-    }
-    
-    arr_elem->value = element;
-    arr_elem->next = NULL;
+    ArrayElement *arr_elem = new_array_element();
+    embed_value(&arr_elem->value, element);
     
     /* Add to the end of the list to maintain order */
     if (array->value.array_head == NULL) {
@@ -163,104 +401,293 @@ void add_array_element(JsonValue *array, JsonValue *element) {
     }
 }
 
-/* Print the AST in an indented format */
-void print_ast(JsonValue *root, int indent) {
-    if (!root) {
-        return;
+/* Queue a member node that still owns memory. The node is copied because
+ * the pair or element holding it is freed right after. */
+static JsonValue* push_pending(JsonValue *pending, size_t *count, size_t *capacity, JsonValue *node) {
+    if (node->flags & JSON_HAS_POSITION) {
+        forget_position(node);
     }
-    
-    char indent_str[256] = {0};
-    for (int i = 0; i < indent; i++) {
-        strcat(indent_str, "  ");
+    if (node->type == JSON_NUMBER || node->type == JSON_BOOLEAN || node->type == JSON_NULL ||
+        (node->type == JSON_STRING && (node->flags & JSON_INLINE_STRING))) {
+        return pending;
     }
     
-    switch (root->type) {
-        case JSON_OBJECT: {
-            printf("%sOBJECT {\n", indent_str);
-            KeyValuePair *pair = root->value.object_head;
-            while (pair) {
-                printf("%s  KEY: \"%s\"\n", indent_str, pair->key);
-                printf("%s  VALUE: ", indent_str);
-                print_ast(pair->value, indent + 2);
-                pair = pair->next;
-            }
-            printf("%s}\n", indent_str);
-            break;
+    if (*count == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 64;
+        pending = (JsonValue*)mem_realloc(MEM_AST, pending, *capacity * sizeof(JsonValue));
+        if (!pending) {
+            fprintf(stderr, "Memory allocation failed while freeing AST\n");
+            exit(1);
         }
+    }
+    pending[(*count)++] = *node;
+    return pending;
+}
+
+/* Free memory for a JSON value, without recursion */
+void free_json_value(JsonValue *value) {
+    if (!value) {
+        return;
+    }
+    
+    /* Copies of nodes whose children have not been released yet */
+    JsonValue *pending = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    
+    pending = push_pending(pending, &count, &capacity, value);
+    mem_free(MEM_AST, value);
+    
+    while (count > 0) {
+        JsonValue node = pending[--count];
         
-        case JSON_ARRAY: {
-            printf("%sARRAY [\n", indent_str);
-            ArrayElement *elem = root->value.array_head;
-            int index = 0;
-            while (elem) {
-                printf("%s  [%d]: ", indent_str, index++);
-                print_ast(elem->value, indent + 2);
-                elem = elem->next;
+        switch (node.type) {
+            case JSON_OBJECT: {
+                KeyValuePair *pair = node.value.object_head;
+                while (pair) {
+                    KeyValuePair *next = pair->next;
+                    pending = push_pending(pending, &count, &capacity, &pair->value);
+                    if (pair->key != pair->short_key) {
+                        mem_free(MEM_STRINGS, pair->key);
+                    }
+                    mem_free(MEM_AST, pair);
+                    pair = next;
+                }
+                break;
             }
-            printf("%s]\n", indent_str);
-            break;
+            
+            case JSON_ARRAY: {
+                ArrayElement *elem = node.value.array_head;
+                while (elem) {
+                    ArrayElement *next = elem->next;
+                    pending = push_pending(pending, &count, &capacity, &elem->value);
+                    mem_free(MEM_AST, elem);
+                    elem = next;
+                }
+                break;
+            }
+            
+            case JSON_STRING:
+                mem_free(MEM_STRINGS, node.value.string_value);
+                break;
+                
+            default:
+                break;
         }
-        
-        case JSON_STRING:
-            printf("%sSTRING: \"%s\"\n", indent_str, root->value.string_value);
+    }
+    
+    mem_free(MEM_AST, pending);
+}
+
+/* Grow a stack of value pointers used by the walks below */
+static JsonValue** grow_value_stack(JsonValue **stack, size_t *capacity, size_t needed) {
+    if (needed <= *capacity) {
+        return stack;
+    }
+    size_t new_capacity = *capacity ? *capacity * 2 : 64;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+    stack = (JsonValue**)mem_realloc(MEM_AST, stack, new_capacity * sizeof(JsonValue*));
+    if (!stack) {
+        fprintf(stderr, "Memory allocation failed for AST walk\n");
+        exit(1);
+    }
+    *capacity = new_capacity;
+    return stack;
+}
+
+/* FNV-1a over a block of bytes */
+static uint64_t hash_bytes(uint64_t hash, const void *data, size_t length) {
+    const unsigned char *bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/* Hash of a scalar on its own */
+static uint64_t hash_scalar(JsonValue *value) {
+    unsigned char tag = (unsigned char)value->type;
+    uint64_t hash = hash_bytes(0xcbf29ce484222325ULL, &tag, 1);
+    
+    switch (value->type) {
+        case JSON_STRING: {
+            const char *text = json_string_text(value);
+            hash = hash_bytes(hash, text, strlen(text) + 1);
             break;
+        }
             
         case JSON_NUMBER:
-            printf("%sNUMBER: %g\n", indent_str, root->value.number_value);
+            hash = hash_bytes(hash, &value->value.number_value, sizeof(double));
             break;
             
         case JSON_BOOLEAN:
-            printf("%sBOOLEAN: %s\n", indent_str, root->value.boolean_value ? "true" : "false");
-            break;
-            
-        case JSON_NULL:
-            printf("%sNULL\n", indent_str);
+            tag = (unsigned char)(value->value.boolean_value != 0);
+            hash = hash_bytes(hash, &tag, 1);
             break;
             
         default:
-            printf("%sUNKNOWN TYPE\n", indent_str);
             break;
     }
+    return hash;
 }
 
-/* Free memory for a JSON value */
-void free_json_value(JsonValue *value) {
-    if (!value) {
-        return;
+/* A container being hashed, with the members still to fold in */
+typedef struct HashFrame {
+    JsonValue *value;
+    KeyValuePair *pair;
+    ArrayElement *elem;
+    uint64_t hash;
+} HashFrame;
+
+/* Hash a value bottom-up: a container folds in its member keys and the
+ * finished hashes of its members, so every node is visited once */
+uint64_t hash_json_tree(JsonValue *value, JsonHashVisit visit, void *arg) {
+    if (value->type != JSON_OBJECT && value->type != JSON_ARRAY) {
+        return hash_scalar(value);
     }
     
-    switch (value->type) {
-        case JSON_OBJECT: {
-            KeyValuePair *pair = value->value.object_head;
-            while (pair) {
-                KeyValuePair *next = pair->next;
-                free(pair->key);
-                free_json_value(pair->value);
-                free(pair);
-                pair = next;
+    HashFrame *frames = NULL;
+    size_t depth = 0;
+    size_t capacity = 0;
+    uint64_t result = 0;
+    
+    while (value) {
+        if (depth == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            frames = (HashFrame*)mem_realloc(MEM_AST, frames, capacity * sizeof(HashFrame));
+            if (!frames) {
+                fprintf(stderr, "Memory allocation failed for AST walk\n");
+                exit(1);
             }
-            break;
         }
+        unsigned char tag = (unsigned char)value->type;
+        HashFrame *frame = &frames[depth++];
+        frame->value = value;
+        frame->pair = value->type == JSON_OBJECT ? value->value.object_head : NULL;
+        frame->elem = value->type == JSON_ARRAY ? value->value.array_head : NULL;
+        frame->hash = hash_bytes(0xcbf29ce484222325ULL, &tag, 1);
+        value = NULL;
         
-        case JSON_ARRAY: {
-            ArrayElement *elem = value->value.array_head;
-            while (elem) {
-                ArrayElement *next = elem->next;
-                free_json_value(elem->value);
-                free(elem);
-                elem = next;
+        /* Fold members in until one is a container, which gets its own
+         * frame; finished containers pass their hash to the parent */
+        while (!value && depth > 0) {
+            HashFrame *top = &frames[depth - 1];
+            JsonValue *member = NULL;
+            if (top->pair) {
+                /* The terminator keeps "ab","c" apart from "a","bc" */
+                top->hash = hash_bytes(top->hash, top->pair->key, strlen(top->pair->key) + 1);
+                member = &top->pair->value;
+                top->pair = top->pair->next;
+            } else if (top->elem) {
+                member = &top->elem->value;
+                top->elem = top->elem->next;
+            }
+            
+            if (member && (member->type == JSON_OBJECT || member->type == JSON_ARRAY)) {
+                value = member;
+                continue;
+            }
+            
+            uint64_t hash;
+            if (member) {
+                hash = hash_scalar(member);
+            } else {
+                hash = hash_bytes(top->hash, top->value->type == JSON_OBJECT ? "}" : "]", 1);
+                depth--;
+                if (depth == 0) {
+                    result = hash;
+                    break;
+                }
+                if (visit && top->value->type == JSON_OBJECT && frames[depth - 1].value->type == JSON_OBJECT) {
+                    visit(arg, top->value, hash);
+                }
             }
+            top = &frames[depth - 1];
+            top->hash = hash_bytes(top->hash, &hash, sizeof(hash));
+        }
+    }
+    
+    mem_free(MEM_AST, frames);
+    return result;
+}
+
+uint64_t hash_json_value(JsonValue *value) {
+    return hash_json_tree(value, NULL, NULL);
+}
+
+/* Compare two values member by member. Numbers must match bit for bit so
+ * values that print differently (0 and -0) are never treated as equal. */
+int json_values_equal(JsonValue *a, JsonValue *b) {
+    JsonValue **stack = NULL;
+    size_t depth = 0;
+    size_t capacity = 0;
+    int equal = 1;
+    
+    while (equal && a) {
+        if (a->type != b->type) {
+            equal = 0;
             break;
         }
         
-        case JSON_STRING:
-            free(value->value.string_value);
-            break;
+        switch (a->type) {
+            case JSON_OBJECT: {
+                KeyValuePair *pa = a->value.object_head;
+                KeyValuePair *pb = b->value.object_head;
+                while (pa && pb) {
+                    if (strcmp(pa->key, pb->key) != 0) {
+                        break;
+                    }
+                    stack = grow_value_stack(stack, &capacity, depth + 2);
+                    stack[depth++] = &pa->value;
+                    stack[depth++] = &pb->value;
+                    pa = pa->next;
+                    pb = pb->next;
+                }
+                equal = !pa && !pb;
+                break;
+            }
             
-        default:
-            /* Nothing to free for other types */
-            break;
+            case JSON_ARRAY: {
+                ArrayElement *ea = a->value.array_head;
+                ArrayElement *eb = b->value.array_head;
+                while (ea && eb) {
+                    stack = grow_value_stack(stack, &capacity, depth + 2);
+                    stack[depth++] = &ea->value;
+                    stack[depth++] = &eb->value;
+                    ea = ea->next;
+                    eb = eb->next;
+                }
+                equal = !ea && !eb;
+                break;
+            }
+            
+            case JSON_STRING:
+                equal = strcmp(json_string_text(a), json_string_text(b)) == 0;
+                break;
+                
+            case JSON_NUMBER:
+                equal = memcmp(&a->value.number_value, &b->value.number_value, sizeof(double)) == 0;
+                break;
+                
+            case JSON_BOOLEAN:
+                equal = (a->value.boolean_value != 0) == (b->value.boolean_value != 0);
+                break;
+                
+            default:
+                break;
+        }
+        
+        if (depth > 0) {
+            b = stack[--depth];
+            a = stack[--depth];
+        } else {
+            a = NULL;
+        }
     }
     
-    free(value);
+    mem_free(MEM_AST, stack);
+    return equal;
 }
@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 
 /* JSON value types */
 typedef enum {
@@ -15,37 +16,65 @@ typedef enum {
     JSON_NULL
 } JsonType;
 
-/* Forward declaration for JsonValue */
+/* Forward declarations */
 typedef struct JsonValue JsonValue;
+typedef struct KeyValuePair KeyValuePair;
+typedef struct ArrayElement ArrayElement;
 
-/* Key-value pair for objects */
-typedef struct KeyValuePair {
-    char *key;
-    JsonValue *value;
-    struct KeyValuePair *next;  /* For linked list */
-} KeyValuePair;
+/* Longest string stored inside its JsonValue, excluding the terminator */
+#define JSON_INLINE_MAX 13
 
-/* Array element */
-typedef struct ArrayElement {
-    JsonValue *value;
-    struct ArrayElement *next;  /* For linked list */
-} ArrayElement;
+/* JsonValue flags */
+#define JSON_INLINE_STRING 0x01   /* String text is held in the node itself */
+#define JSON_HAS_POSITION  0x02   /* Source position is in the position table */
 
-/* JSON value structure */
+/* JSON value structure: 16 bytes. Strings of up to JSON_INLINE_MAX bytes
+ * overlay the payload and need no allocation of their own; use
+ * json_string_text to read a string either way. Source positions are not
+ * kept in the node (see json_track_positions). */
 struct JsonValue {
-    JsonType type;
     union {
-        KeyValuePair *object_head;  /* For objects */
-        ArrayElement *array_head;   /* For arrays */
-        char *string_value;         /* For strings */
-        double number_value;        /* For numbers */
-        int boolean_value;          /* For booleans (0 or 1) */
-    } value;
-    int line;                       /* Line number for error reporting */
-    int column;                     /* Column number for error reporting */
+        struct {
+            uint8_t type;                   /* JsonType */
+            uint8_t flags;                  /* JSON_INLINE_STRING, ... */
+            union {
+                KeyValuePair *object_head;  /* For objects */
+                ArrayElement *array_head;   /* For arrays */
+                char *string_value;         /* For long strings */
+                double number_value;        /* For numbers */
+                int boolean_value;          /* For booleans (0 or 1) */
+            } value;
+        };
+        struct {
+            uint8_t header[2];              /* type and flags */
+            char inline_string[JSON_INLINE_MAX + 1];
+        };
+    };
+};
+
+/* Key-value pair for objects. The value node is stored in the pair and
+ * keys of up to 7 bytes in short_key, so a typical member is a single
+ * 40-byte allocation. */
+struct KeyValuePair {
+    char *key;                  /* short_key or a heap string */
+    struct KeyValuePair *next;  /* For linked list */
+    JsonValue value;
+    char short_key[8];
+};
+
+/* Array element; the value node is stored in the element */
+struct ArrayElement {
+    struct ArrayElement *next;  /* For linked list */
+    JsonValue value;
 };
 
-/* AST creation functions */
+/* Text of a JSON_STRING value */
+static inline const char* json_string_text(const JsonValue *value) {
+    return (value->flags & JSON_INLINE_STRING) ? value->inline_string : value->value.string_value;
+}
+
+/* AST creation functions. These allocate a standalone node, as used for
+ * a document root; members are built in place (see below). */
 JsonValue* create_object(int line, int column);
 JsonValue* create_array(int line, int column);
 JsonValue* create_string(char *value, int line, int column);
@@ -53,14 +82,52 @@ JsonValue* create_number(double value, int line, int column);
 JsonValue* create_boolean(int value, int line, int column);
 JsonValue* create_null(int line, int column);
 
-/* Object and array manipulation */
+JsonValue* create_string_owned(char *value, int line, int column);
+
+/* In-place construction, used by the parsers so that each member's value
+ * is written once, straight into its pair or element. new_key_value (which
+ * takes ownership of key), new_key_value_copy and new_array_element return
+ * an unlinked link holding null; the caller fills link->value with an
+ * init_* function and appends the link after its list's tail.
+ * new_json_value allocates a root to fill the same way. init_string_owned
+ * takes ownership of its text and init_string copies it. The init_*
+ * functions overwrite the whole node, so set_json_position must come after
+ * them. */
+KeyValuePair* new_key_value(char *key);
+KeyValuePair* new_key_value_copy(const char *key);
+ArrayElement* new_array_element(void);
+JsonValue* new_json_value(void);
+void init_object(JsonValue *node);
+void init_array(JsonValue *node);
+void init_string_owned(JsonValue *node, char *value);
+void init_string(JsonValue *node, const char *value);
+void init_number(JsonValue *node, double value);
+void init_boolean(JsonValue *node, int value);
+void init_null(JsonValue *node);
+void set_json_position(JsonValue *node, int line, int column);
+
+/* Object and array manipulation for standalone nodes. The node is moved
+ * into the new pair or element and the original freed; use the link's
+ * value from then on. */
 void add_key_value(JsonValue *object, char *key, JsonValue *value);
 void add_array_element(JsonValue *array, JsonValue *element);
 
-/* AST traversal and printing */
-void print_ast(JsonValue *root, int indent);
+/* Source positions. When json_track_positions is set (before parsing
+ * starts), the creation functions record each node's line and column in a
+ * table beside the AST; otherwise positions are dropped. Returns 0 when no
+ * position is known for value. */
+extern int json_track_positions;
+int json_value_position(const JsonValue *value, int *line, int *column);
+
+/* Structural hashing and comparison, used to deduplicate sub-objects.
+ * hash_json_tree also reports the hash of every object nested under a
+ * key to visit, so callers need not hash those subtrees again. */
+typedef void (*JsonHashVisit)(void *arg, JsonValue *object, uint64_t hash);
+uint64_t hash_json_tree(JsonValue *value, JsonHashVisit visit, void *arg);
+uint64_t hash_json_value(JsonValue *value);
+int json_values_equal(JsonValue *a, JsonValue *b);
 
-/* Memory management */
+/* Memory management: frees a value that is not part of a pair or element */
 void free_json_value(JsonValue *value);
 
 #endif /* AST_H */
@@ -0,0 +1,360 @@
+#include "ast_dump.h"
+#include "number_format.h"
+#include "mem.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+/*
+ * AST dumper for --print-ast.
+ *
+ * Everything is formatted into one output buffer that is written out when
+ * it fills, instead of a printf call per node. Indentation is copied from a
+ * constant run of spaces in slices, so any depth works. Open containers
+ * live on an explicit stack, like the other tree walks in ast.c.
+ */
+
+#define DUMP_BUFFER_SIZE (64 * 1024)
+
+static const char dump_spaces[] = "                                                                ";
+
+/* A container whose members are still being printed */
+typedef struct DumpFrame {
+    const JsonValue *node;
+    const KeyValuePair *pair;    /* Next pair of an object */
+    const ArrayElement *elem;    /* Next element of an array */
+    int index;                   /* Members printed so far */
+    int indent;                  /* Indentation level of the tree format */
+    int depth;                   /* Containers above this one */
+} DumpFrame;
+
+typedef struct Dumper {
+    FILE *out;
+    const AstDumpOptions *options;
+    char *buffer;
+    size_t used;
+    unsigned long nodes;         /* Values printed so far */
+    DumpFrame *stack;
+    int depth;
+    int capacity;
+} Dumper;
+
+static void dump_flush(Dumper *d) {
+    if (d->used > 0) {
+        fwrite(d->buffer, 1, d->used, d->out);
+        d->used = 0;
+    }
+}
+
+static void dump_write(Dumper *d, const char *data, size_t length) {
+    if (d->used + length > DUMP_BUFFER_SIZE) {
+        dump_flush(d);
+        if (length > DUMP_BUFFER_SIZE) {
+            fwrite(data, 1, length, d->out);
+            return;
+        }
+    }
+    memcpy(d->buffer + d->used, data, length);
+    d->used += length;
+}
+
+static void dump_text(Dumper *d, const char *text) {
+    dump_write(d, text, strlen(text));
+}
+
+static void dump_indent(Dumper *d, int count) {
+    while (count > 0) {
+        int slice = count < (int)sizeof(dump_spaces) - 1 ? count : (int)sizeof(dump_spaces) - 1;
+        dump_write(d, dump_spaces, slice);
+        count -= slice;
+    }
+}
+
+/* A string as a JSON literal, escaping quotes, backslashes and control
+ * characters; the S-expression format uses the same syntax */
+static void dump_quoted(Dumper *d, const char *text) {
+    dump_write(d, "\"", 1);
+    const char *run = text;
+    const char *p = text;
+    for (; *p; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        dump_write(d, run, p - run);
+        run = p + 1;
+
+        char escape[8];
+        switch (c) {
+            case '"':  dump_text(d, "\\\""); break;
+            case '\\': dump_text(d, "\\\\"); break;
+            case '\b': dump_text(d, "\\b"); break;
+            case '\f': dump_text(d, "\\f"); break;
+            case '\n': dump_text(d, "\\n"); break;
+            case '\r': dump_text(d, "\\r"); break;
+            case '\t': dump_text(d, "\\t"); break;
+            default:
+                snprintf(escape, sizeof(escape), "\\u%04x", c);
+                dump_text(d, escape);
+                break;
+        }
+    }
+    dump_write(d, run, p - run);
+    dump_write(d, "\"", 1);
+}
+
+/* Finish a line of the tree format, with the node's source position */
+static void dump_line_end(Dumper *d, const JsonValue *node) {
+    int line, column;
+    if (json_value_position(node, &line, &column)) {
+        char position[32];
+        snprintf(position, sizeof(position), "  @%d:%d", line, column);
+        dump_text(d, position);
+    }
+    dump_write(d, "\n", 1);
+}
+
+static void dump_scalar(Dumper *d, const JsonValue *node) {
+    int tree = d->options->format == AST_DUMP_TREE;
+    char number[NUMBER_FORMAT_MAX];
+
+    switch (node->type) {
+        case JSON_STRING:
+            if (tree) {
+                dump_text(d, "STRING: \"");
+                dump_text(d, json_string_text(node));
+                dump_write(d, "\"", 1);
+            } else {
+                dump_quoted(d, json_string_text(node));
+            }
+            break;
+
+        case JSON_NUMBER:
+            if (tree) {
+                snprintf(number, sizeof(number), "%g", node->value.number_value);
+                dump_text(d, "NUMBER: ");
+            } else if (isinf(node->value.number_value)) {
+                /* Out-of-range literals read back as the same infinity */
+                strcpy(number, node->value.number_value < 0 ? "-1e999" : "1e999");
+            } else {
+                format_double(node->value.number_value, number);
+            }
+            dump_text(d, number);
+            break;
+
+        case JSON_BOOLEAN:
+            if (tree) {
+                dump_text(d, "BOOLEAN: ");
+            }
+            dump_text(d, node->value.boolean_value ? "true" : "false");
+            break;
+
+        case JSON_NULL:
+            dump_text(d, tree ? "NULL" : "null");
+            break;
+
+        default:
+            dump_text(d, tree ? "UNKNOWN TYPE" : "null");
+            break;
+    }
+}
+
+/* Print a value. Containers within the depth limit are opened and pushed
+ * to have their members printed; deeper ones are printed as "...". */
+static void dump_value(Dumper *d, const JsonValue *node, int indent, int depth) {
+    d->nodes++;
+
+    if (node->type != JSON_OBJECT && node->type != JSON_ARRAY) {
+        if (d->options->format == AST_DUMP_TREE) {
+            dump_indent(d, indent * 2);
+            dump_scalar(d, node);
+            dump_line_end(d, node);
+        } else {
+            dump_scalar(d, node);
+        }
+        return;
+    }
+
+    int object = node->type == JSON_OBJECT;
+    int elided = d->options->max_depth > 0 && depth >= d->options->max_depth;
+
+    switch (d->options->format) {
+        case AST_DUMP_TREE:
+            dump_indent(d, indent * 2);
+            if (object) {
+                dump_text(d, elided ? "OBJECT { ... }" : "OBJECT {");
+            } else {
+                dump_text(d, elided ? "ARRAY [ ... ]" : "ARRAY [");
+            }
+            dump_line_end(d, node);
+            break;
+
+        case AST_DUMP_JSON:
+            dump_text(d, elided ? "\"...\"" : object ? "{" : "[");
+            break;
+
+        case AST_DUMP_SEXPR:
+            dump_text(d, object ? "(object" : "(array");
+            if (elided) {
+                dump_text(d, " ...)");
+            }
+            break;
+    }
+    if (elided) {
+        return;
+    }
+
+    if (d->depth == d->capacity) {
+        d->capacity = d->capacity ? d->capacity * 2 : 32;
+        d->stack = (DumpFrame*)mem_realloc(MEM_OUTPUT, d->stack, d->capacity * sizeof(DumpFrame));
+        if (!d->stack) {
+            fprintf(stderr, "Memory allocation failed for AST printer stack\n");
+            exit(1);
+        }
+    }
+    DumpFrame *frame = &d->stack[d->depth++];
+    frame->node = node;
+    frame->pair = object ? node->value.object_head : NULL;
+    frame->elem = object ? NULL : node->value.array_head;
+    frame->index = 0;
+    frame->indent = indent;
+    frame->depth = depth;
+}
+
+/* Print what comes before a member's value: its key or index */
+static void dump_member(Dumper *d, const DumpFrame *frame, const char *key) {
+    switch (d->options->format) {
+        case AST_DUMP_TREE:
+            dump_indent(d, frame->indent * 2);
+            if (key) {
+                dump_text(d, "  KEY: \"");
+                dump_text(d, key);
+                dump_text(d, "\"\n");
+                dump_indent(d, frame->indent * 2);
+                dump_text(d, "  VALUE: ");
+            } else {
+                char index[32];
+                snprintf(index, sizeof(index), "  [%d]: ", frame->index);
+                dump_text(d, index);
+            }
+            break;
+
+        case AST_DUMP_JSON:
+            if (frame->index > 0) {
+                dump_write(d, ",", 1);
+            }
+            if (key) {
+                dump_quoted(d, key);
+                dump_write(d, ":", 1);
+            }
+            break;
+
+        case AST_DUMP_SEXPR:
+            dump_write(d, " ", 1);
+            if (key) {
+                dump_quoted(d, key);
+                dump_write(d, " ", 1);
+            }
+            break;
+    }
+}
+
+/* Stand in for the members left out by the node limit */
+static void dump_cut(Dumper *d, const DumpFrame *frame) {
+    int object = frame->node->type == JSON_OBJECT;
+
+    switch (d->options->format) {
+        case AST_DUMP_TREE:
+            dump_indent(d, frame->indent * 2);
+            dump_text(d, "  ...\n");
+            break;
+
+        case AST_DUMP_JSON:
+            if (frame->index > 0) {
+                dump_write(d, ",", 1);
+            }
+            dump_text(d, object ? "\"...\":\"...\"" : "\"...\"");
+            break;
+
+        case AST_DUMP_SEXPR:
+            dump_text(d, " ...");
+            break;
+    }
+}
+
+static void dump_close(Dumper *d, const DumpFrame *frame) {
+    int object = frame->node->type == JSON_OBJECT;
+
+    switch (d->options->format) {
+        case AST_DUMP_TREE:
+            dump_indent(d, frame->indent * 2);
+            dump_text(d, object ? "}\n" : "]\n");
+            break;
+
+        case AST_DUMP_JSON:
+            dump_write(d, object ? "}" : "]", 1);
+            break;
+
+        case AST_DUMP_SEXPR:
+            dump_write(d, ")", 1);
+            break;
+    }
+}
+
+/* Print a document without recursion */
+void dump_ast(FILE *out, const JsonValue *root, const AstDumpOptions *options) {
+    if (!root) {
+        return;
+    }
+
+    Dumper d;
+    memset(&d, 0, sizeof(d));
+    d.out = out;
+    d.options = options;
+    d.buffer = (char*)mem_alloc(MEM_OUTPUT, DUMP_BUFFER_SIZE);
+    if (!d.buffer) {
+        fprintf(stderr, "Memory allocation failed for AST printer buffer\n");
+        exit(1);
+    }
+
+    dump_value(&d, root, 0, 0);
+
+    while (d.depth > 0) {
+        DumpFrame *top = &d.stack[d.depth - 1];
+        int object = top->node->type == JSON_OBJECT;
+        int more = object ? top->pair != NULL : top->elem != NULL;
+
+        if (more && options->max_nodes > 0 && d.nodes >= options->max_nodes) {
+            dump_cut(&d, top);
+            more = 0;
+        }
+        if (!more) {
+            dump_close(&d, top);
+            d.depth--;
+            continue;
+        }
+
+        const JsonValue *child;
+        const char *key = NULL;
+        if (object) {
+            key = top->pair->key;
+            child = &top->pair->value;
+            top->pair = top->pair->next;
+        } else {
+            child = &top->elem->value;
+            top->elem = top->elem->next;
+        }
+        dump_member(&d, top, key);
+        top->index++;
+
+        /* May grow the stack, so top is not used after this */
+        dump_value(&d, child, top->indent + 2, top->depth + 1);
+    }
+
+    if (options->format != AST_DUMP_TREE) {
+        dump_write(&d, "\n", 1);
+    }
+    dump_flush(&d);
+    mem_free(MEM_OUTPUT, d.buffer);
+    mem_free(MEM_OUTPUT, d.stack);
+}
@@ -0,0 +1,27 @@
+#ifndef AST_DUMP_H
+#define AST_DUMP_H
+
+#include <stdio.h>
+#include "ast.h"
+
+/* Output formats of --print-ast */
+typedef enum {
+    AST_DUMP_TREE,    /* Indented listing of nodes, keys and indexes (default) */
+    AST_DUMP_JSON,    /* Compact JSON, one line per document */
+    AST_DUMP_SEXPR    /* S-expressions: (object KEY VALUE ...), (array VALUE ...) */
+} AstDumpFormat;
+
+typedef struct AstDumpOptions {
+    AstDumpFormat format;
+    int max_depth;            /* Levels of containers shown, the root being 1 (0: no limit) */
+    unsigned long max_nodes;  /* Values printed before the rest is cut off (0: no limit) */
+} AstDumpOptions;
+
+/* Print a document to out. Output goes through one buffer and the tree is
+ * walked with an explicit stack, so memory use does not grow with the
+ * document. Elided containers and members cut off by max_nodes are shown
+ * as "..."; JSON output stays well-formed. The tree format includes
+ * source positions when they were recorded. */
+void dump_ast(FILE *out, const JsonValue *root, const AstDumpOptions *options);
+
+#endif /* AST_DUMP_H */
@@ -0,0 +1,497 @@
+#include "async_io.h"
+#include "mem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+/* Writes merged into one pwritev call by the worker thread */
+#define ASYNC_IOV_BATCH 64
+
+/* Pending write of one heap buffer */
+struct AsyncRequest {
+    AsyncFile *file;
+    char *data;
+    struct iovec iov;    /* Must stay valid until an io_uring write completes */
+    off_t offset;
+    AsyncRequest *next;  /* Worker queue link */
+};
+
+/* Write a whole buffer at an offset, retrying short writes */
+static int pwrite_all(int fd, const char *data, size_t len, off_t offset) {
+    while (len > 0) {
+        ssize_t n = pwrite(fd, data, len, offset);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        data += n;
+        len -= n;
+        offset += n;
+    }
+    return 0;
+}
+
+/* Finish a request: report errors, release the buffer and close the file
+ * if it was waiting for this write. The thread backend calls this with
+ * writer->lock held; the io_uring backend runs on the caller's thread. */
+static void complete_request(AsyncWriter *writer, AsyncRequest *req, long result) {
+    AsyncFile *file = req->file;
+
+    if (result >= 0 && (size_t)result < req->iov.iov_len) {
+        /* Short write: finish the remainder synchronously */
+        result = pwrite_all(file->fd, req->data + result, req->iov.iov_len - result, req->offset + result);
+    }
+    if (result < 0) {
+        fprintf(stderr, "Error writing file %s: %s\n", file->path, strerror((int)-result));
+        writer->status = -1;
+    }
+
+    mem_free(MEM_OUTPUT, req->data);
+    mem_free(MEM_OUTPUT, req);
+    writer->in_flight--;
+
+    if (--file->pending == 0 && file->closing) {
+        if (close(file->fd) != 0) {
+            fprintf(stderr, "Error closing file %s: %s\n", file->path, strerror(errno));
+            writer->status = -1;
+        }
+        mem_free(MEM_OUTPUT, file->path);
+        mem_free(MEM_OUTPUT, file);
+    }
+}
+
+/* ---- io_uring backend ----------------------------------------------- */
+
+#ifdef HAVE_IO_URING
+/* Map the submission and completion rings of a new io_uring instance */
+static int uring_init(AsyncWriter *writer, unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    int fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0) {
+        return -1;  /* Not supported or not permitted: use the thread backend */
+    }
+
+    writer->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    writer->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (writer->cq_ring_size > writer->sq_ring_size) {
+            writer->sq_ring_size = writer->cq_ring_size;
+        }
+        writer->cq_ring_size = writer->sq_ring_size;
+    }
+
+    writer->sq_ring = mmap(NULL, writer->sq_ring_size, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (writer->sq_ring == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        writer->cq_ring = writer->sq_ring;
+    } else {
+        writer->cq_ring = mmap(NULL, writer->cq_ring_size, PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (writer->cq_ring == MAP_FAILED) {
+            munmap(writer->sq_ring, writer->sq_ring_size);
+            close(fd);
+            return -1;
+        }
+    }
+
+    writer->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    writer->sqes = mmap(NULL, writer->sqes_size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (writer->sqes == MAP_FAILED) {
+        if (writer->cq_ring != writer->sq_ring) {
+            munmap(writer->cq_ring, writer->cq_ring_size);
+        }
+        munmap(writer->sq_ring, writer->sq_ring_size);
+        close(fd);
+        return -1;
+    }
+
+    char *sq = (char*)writer->sq_ring;
+    char *cq = (char*)writer->cq_ring;
+    writer->sq_head = (unsigned*)(sq + params.sq_off.head);
+    writer->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    writer->sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+    writer->sq_array = (unsigned*)(sq + params.sq_off.array);
+    writer->cq_head = (unsigned*)(cq + params.cq_off.head);
+    writer->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    writer->cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+    writer->cqes = cq + params.cq_off.cqes;
+
+    writer->ring_fd = fd;
+    if (writer->queue_depth > params.sq_entries) {
+        writer->queue_depth = params.sq_entries;
+    }
+    return 0;
+}
+
+/* Process every available completion */
+static void uring_reap(AsyncWriter *writer) {
+    struct io_uring_cqe *cqes = (struct io_uring_cqe*)writer->cqes;
+    unsigned head = *writer->cq_head;
+
+    while (head != __atomic_load_n(writer->cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe *cqe = &cqes[head & *writer->cq_mask];
+        AsyncRequest *req = (AsyncRequest*)(uintptr_t)cqe->user_data;
+        long result = cqe->res;
+        head++;
+        complete_request(writer, req, result);
+    }
+
+    __atomic_store_n(writer->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/* Submit queued SQEs, optionally waiting for some completions */
+static void uring_submit(AsyncWriter *writer, unsigned wait_for) {
+    for (;;) {
+        unsigned flags = wait_for ? IORING_ENTER_GETEVENTS : 0;
+        int ret = (int)syscall(__NR_io_uring_enter, writer->ring_fd, writer->sq_queued,
+                               wait_for, flags, NULL, 0);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "Error submitting writes: %s\n", strerror(errno));
+            exit(1);
+        }
+        writer->sq_queued -= (unsigned)ret;
+        if (writer->sq_queued == 0 || wait_for) {
+            break;
+        }
+    }
+    uring_reap(writer);
+}
+
+/* Add a write to the submission ring, submitting full batches */
+static void uring_queue(AsyncWriter *writer, AsyncRequest *req) {
+    /* Keep completions within the ring's capacity */
+    while (writer->in_flight >= writer->queue_depth) {
+        uring_submit(writer, 1);
+    }
+
+    unsigned tail = *writer->sq_tail;
+    unsigned index = tail & *writer->sq_mask;
+    struct io_uring_sqe *sqe = &((struct io_uring_sqe*)writer->sqes)[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_WRITEV;
+    sqe->fd = req->file->fd;
+    sqe->addr = (unsigned long)&req->iov;
+    sqe->len = 1;
+    sqe->off = (unsigned long long)req->offset;
+    sqe->user_data = (unsigned long long)(uintptr_t)req;
+
+    writer->sq_array[index] = index;
+    __atomic_store_n(writer->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    writer->sq_queued++;
+    writer->in_flight++;
+
+    /* Submit in batches to amortize the system call */
+    if (writer->sq_queued >= writer->queue_depth / 2) {
+        uring_submit(writer, 0);
+    }
+}
+
+/* Wait for all writes and release the ring */
+static void uring_destroy(AsyncWriter *writer) {
+    while (writer->in_flight > 0) {
+        uring_submit(writer, 1);
+    }
+
+    munmap(writer->sqes, writer->sqes_size);
+    if (writer->cq_ring != writer->sq_ring) {
+        munmap(writer->cq_ring, writer->cq_ring_size);
+    }
+    munmap(writer->sq_ring, writer->sq_ring_size);
+    close(writer->ring_fd);
+}
+#endif
+
+/* ---- Worker thread backend ------------------------------------------ */
+
+/* Write a group of contiguous requests for one file with pwritev */
+static long write_group(AsyncRequest *first, int count) {
+    struct iovec iov[ASYNC_IOV_BATCH];
+    size_t total = 0;
+    AsyncRequest *req = first;
+    for (int i = 0; i < count; i++, req = req->next) {
+        iov[i] = req->iov;
+        total += req->iov.iov_len;
+    }
+
+    int fd = first->file->fd;
+    off_t offset = first->offset;
+    ssize_t n = pwritev(fd, iov, count, offset);
+    if (n < 0) {
+        return -errno;
+    }
+    if ((size_t)n < total) {
+        return n;  /* Completion finishes short writes per request */
+    }
+    return (long)total;
+}
+
+/* Drain the request queue, merging contiguous writes into pwritev calls */
+static void* writer_thread(void *arg) {
+    AsyncWriter *writer = (AsyncWriter*)arg;
+
+    pthread_mutex_lock(&writer->lock);
+    for (;;) {
+        while (!writer->queue_head && !writer->stopping) {
+            pthread_cond_wait(&writer->work_ready, &writer->lock);
+        }
+        if (!writer->queue_head) {
+            break;  /* Stopping and nothing left */
+        }
+
+        AsyncRequest *batch = writer->queue_head;
+        writer->queue_head = writer->queue_tail = NULL;
+        pthread_mutex_unlock(&writer->lock);
+
+        while (batch) {
+            /* Collect writes that continue each other in the same file */
+            AsyncRequest *first = batch;
+            int count = 0;
+            off_t end = first->offset;
+            AsyncRequest *req = first;
+            while (req && count < ASYNC_IOV_BATCH && req->file == first->file && req->offset == end) {
+                end += req->iov.iov_len;
+                count++;
+                req = req->next;
+            }
+            batch = req;
+
+            long written = write_group(first, count);
+
+            /* Hand each request its share of the result */
+            pthread_mutex_lock(&writer->lock);
+            req = first;
+            for (int i = 0; i < count; i++) {
+                AsyncRequest *next = req->next;
+                long result;
+                if (written < 0) {
+                    result = written;
+                } else {
+                    result = written < (long)req->iov.iov_len ? written : (long)req->iov.iov_len;
+                    written -= result;
+                }
+                complete_request(writer, req, result);
+                req = next;
+            }
+            pthread_cond_broadcast(&writer->work_done);
+            pthread_mutex_unlock(&writer->lock);
+        }
+
+        pthread_mutex_lock(&writer->lock);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+/* ---- Public interface ----------------------------------------------- */
+
+/* Create a writer; io_uring is used when available, else a pwritev thread */
+AsyncWriter* async_writer_create(unsigned queue_depth) {
+    AsyncWriter *writer = (AsyncWriter*)mem_calloc(MEM_OUTPUT, 1, sizeof(AsyncWriter));
+    if (!writer) {
+        fprintf(stderr, "Memory allocation failed for async writer\n");
+        exit(1);
+    }
+
+    writer->queue_depth = queue_depth < 2 ? 2 : queue_depth;
+    writer->ring_fd = -1;
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->work_ready, NULL);
+    pthread_cond_init(&writer->work_done, NULL);
+
+#ifdef HAVE_IO_URING
+    if (uring_init(writer, writer->queue_depth) == 0) {
+        writer->backend = ASYNC_IO_URING;
+        return writer;
+    }
+#endif
+
+    writer->backend = ASYNC_IO_THREAD;
+    if (pthread_create(&writer->thread, NULL, writer_thread, writer) != 0) {
+        fprintf(stderr, "Error starting writer thread\n");
+        exit(1);
+    }
+    return writer;
+}
+
+/* Wait until every queued write has completed, which also closes the
+ * files waiting for them */
+static void wait_for_writes(AsyncWriter *writer) {
+#ifdef HAVE_IO_URING
+    if (writer->backend == ASYNC_IO_URING) {
+        while (writer->in_flight > 0) {
+            uring_submit(writer, 1);
+        }
+        return;
+    }
+#endif
+    pthread_mutex_lock(&writer->lock);
+    while (writer->in_flight > 0) {
+        pthread_cond_wait(&writer->work_done, &writer->lock);
+    }
+    pthread_mutex_unlock(&writer->lock);
+}
+
+/* Open an output file, truncating it unless appending */
+AsyncFile* async_file_open(AsyncWriter *writer, const char *path, int append) {
+    AsyncFile *file = (AsyncFile*)mem_calloc(MEM_OUTPUT, 1, sizeof(AsyncFile));
+    if (!file) {
+        fprintf(stderr, "Memory allocation failed for output file\n");
+        exit(1);
+    }
+
+    int flags = O_WRONLY | O_CREAT | (append ? 0 : O_TRUNC);
+    file->fd = open(path, flags, 0644);
+    if (file->fd < 0 && (errno == EMFILE || errno == ENFILE)) {
+        /* Closed files keep their descriptors until their queued writes
+         * land; let them finish and try again */
+        wait_for_writes(writer);
+        file->fd = open(path, flags, 0644);
+    }
+    if (file->fd < 0) {
+        fprintf(stderr, "Error opening file %s for writing: %s\n", path, strerror(errno));
+        mem_free(MEM_OUTPUT, file);
+        return NULL;
+    }
+
+    /* Positional writes continue from the current end of the file */
+    if (append) {
+        file->offset = lseek(file->fd, 0, SEEK_END);
+        if (file->offset < 0) {
+            fprintf(stderr, "Error seeking in file %s: %s\n", path, strerror(errno));
+            close(file->fd);
+            mem_free(MEM_OUTPUT, file);
+            return NULL;
+        }
+    }
+
+    file->path = mem_strdup(MEM_OUTPUT, path);
+    if (!file->path) {
+        fprintf(stderr, "Memory allocation failed for output file\n");
+        exit(1);
+    }
+    return file;
+}
+
+/* Queue a write of a malloc'd buffer at the file's current end */
+void async_file_write(AsyncWriter *writer, AsyncFile *file, char *data, size_t len) {
+    if (len == 0) {
+        mem_free(MEM_OUTPUT, data);
+        return;
+    }
+
+    AsyncRequest *req = (AsyncRequest*)mem_alloc(MEM_OUTPUT, sizeof(AsyncRequest));
+    if (!req) {
+        fprintf(stderr, "Memory allocation failed for write request\n");
+        exit(1);
+    }
+    req->file = file;
+    req->data = data;
+    req->iov.iov_base = data;
+    req->iov.iov_len = len;
+    req->offset = file->offset;
+    req->next = NULL;
+    file->offset += len;
+
+    pthread_mutex_lock(&writer->lock);
+    file->pending++;
+
+#ifdef HAVE_IO_URING
+    if (writer->backend == ASYNC_IO_URING) {
+        pthread_mutex_unlock(&writer->lock);
+        uring_queue(writer, req);
+        return;
+    }
+#endif
+
+    /* Bound the memory held by queued buffers */
+    while (writer->in_flight >= writer->queue_depth) {
+        pthread_cond_wait(&writer->work_done, &writer->lock);
+    }
+    writer->in_flight++;
+
+    if (writer->queue_tail) {
+        writer->queue_tail->next = req;
+    } else {
+        writer->queue_head = req;
+    }
+    writer->queue_tail = req;
+    pthread_cond_signal(&writer->work_ready);
+    pthread_mutex_unlock(&writer->lock);
+}
+
+/* Close a file once its queued writes are complete */
+void async_file_close(AsyncWriter *writer, AsyncFile *file) {
+    pthread_mutex_lock(&writer->lock);
+    if (file->pending > 0) {
+        file->closing = 1;  /* The last completion closes it */
+        pthread_mutex_unlock(&writer->lock);
+        return;
+    }
+    pthread_mutex_unlock(&writer->lock);
+
+    if (close(file->fd) != 0) {
+        fprintf(stderr, "Error closing file %s: %s\n", file->path, strerror(errno));
+        writer->status = -1;
+    }
+    mem_free(MEM_OUTPUT, file->path);
+    mem_free(MEM_OUTPUT, file);
+}
+
+/* Submit any batched writes without waiting for them */
+void async_writer_flush(AsyncWriter *writer) {
+#ifdef HAVE_IO_URING
+    if (writer->backend == ASYNC_IO_URING) {
+        uring_submit(writer, 0);
+    }
+#else
+    (void)writer;  /* The worker thread picks up writes as they are queued */
+#endif
+}
+
+/* Wait for every write, close all files and free the writer */
+int async_writer_destroy(AsyncWriter *writer) {
+#ifdef HAVE_IO_URING
+    if (writer->backend == ASYNC_IO_URING) {
+        uring_destroy(writer);
+    }
+#endif
+
+    if (writer->backend == ASYNC_IO_THREAD) {
+        pthread_mutex_lock(&writer->lock);
+        writer->stopping = 1;
+        pthread_cond_signal(&writer->work_ready);
+        pthread_mutex_unlock(&writer->lock);
+        pthread_join(writer->thread, NULL);
+    }
+
+    int status = writer->status;
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->work_ready);
+    pthread_cond_destroy(&writer->work_done);
+    mem_free(MEM_OUTPUT, writer);
+    return status;
+}
@@ -0,0 +1,76 @@
+#ifndef ASYNC_IO_H
+#define ASYNC_IO_H
+
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+/* I/O backends for the asynchronous writer */
+typedef enum {
+    ASYNC_IO_URING,    /* Linux io_uring (needs HAVE_IO_URING and kernel support) */
+    ASYNC_IO_THREAD    /* Worker thread issuing batched pwritev calls */
+} AsyncBackend;
+
+/* Pending write of one heap buffer */
+typedef struct AsyncRequest AsyncRequest;
+
+/* An output file written through the asynchronous layer */
+typedef struct AsyncFile {
+    int fd;
+    char *path;
+    off_t offset;        /* Offset of the next queued write */
+    int pending;         /* Writes not yet completed */
+    int closing;         /* Close the descriptor once pending reaches zero */
+} AsyncFile;
+
+/* Asynchronous writer shared by all output files of a run */
+typedef struct AsyncWriter {
+    AsyncBackend backend;
+    int status;                  /* Nonzero after any failed write */
+    unsigned queue_depth;        /* Writes submitted per batch */
+    unsigned in_flight;          /* Writes submitted but not completed */
+
+    /* io_uring state */
+    int ring_fd;
+    void *sq_ring;
+    void *cq_ring;
+    void *sqes;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    void *cqes;
+    unsigned sq_queued;          /* SQEs filled but not yet submitted */
+
+    /* Worker thread state */
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+    AsyncRequest *queue_head;
+    AsyncRequest *queue_tail;
+    int stopping;
+} AsyncWriter;
+
+/* Create a writer; io_uring is used when available, else a pwritev thread */
+AsyncWriter* async_writer_create(unsigned queue_depth);
+
+/* Open an output file, truncating it unless appending */
+AsyncFile* async_file_open(AsyncWriter *writer, const char *path, int append);
+
+/* Queue a write of a malloc'd buffer at the file's current end.
+ * The writer takes ownership of data and frees it when the write completes. */
+void async_file_write(AsyncWriter *writer, AsyncFile *file, char *data, size_t len);
+
+/* Close a file once its queued writes are complete */
+void async_file_close(AsyncWriter *writer, AsyncFile *file);
+
+/* Submit any batched writes without waiting for them */
+void async_writer_flush(AsyncWriter *writer);
+
+/* Wait for every write, close all files and free the writer.
+ * Returns nonzero if any write failed. */
+int async_writer_destroy(AsyncWriter *writer);
+
+#endif /* ASYNC_IO_H */
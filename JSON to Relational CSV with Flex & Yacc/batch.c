@@ -0,0 +1,292 @@
+#include "batch.h"
+#include "stats.h"
+#include "mem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* Extensions recognised when listing a directory */
+static const char *batch_suffixes[] = { ".json", ".json.gz", ".json.zst" };
+
+/* Does name end in suffix (with something before it)? */
+static int has_suffix(const char *name, const char *suffix) {
+    size_t name_len = strlen(name);
+    size_t suffix_len = strlen(suffix);
+    return name_len > suffix_len && strcmp(name + name_len - suffix_len, suffix) == 0;
+}
+
+static void add_batch_path(BatchList *list, const char *path) {
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 64;
+        list->paths = (char**)mem_realloc(MEM_INPUT, list->paths, list->capacity * sizeof(char*));
+        if (!list->paths) {
+            fprintf(stderr, "Memory allocation failed for batch list\n");
+            exit(1);
+        }
+    }
+    list->paths[list->count] = mem_strdup(MEM_INPUT, path);
+    if (!list->paths[list->count]) {
+        fprintf(stderr, "Memory allocation failed for batch list\n");
+        exit(1);
+    }
+    list->count++;
+}
+
+static int compare_paths(const void *a, const void *b) {
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+/* Add the JSON files directly inside dir, sorted so runs are repeatable */
+static void list_directory(BatchList *list, const char *dir) {
+    DIR *handle = opendir(dir);
+    if (!handle) {
+        fprintf(stderr, "Error opening batch directory %s: %s\n", dir, strerror(errno));
+        exit(1);
+    }
+
+    struct dirent *entry;
+    char path[4096];
+    while ((entry = readdir(handle)) != NULL) {
+        int matched = 0;
+        for (size_t i = 0; i < sizeof(batch_suffixes) / sizeof(batch_suffixes[0]); i++) {
+            matched |= has_suffix(entry->d_name, batch_suffixes[i]);
+        }
+        if (!matched) {
+            continue;
+        }
+
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+        struct stat st;
+        if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+            add_batch_path(list, path);
+        }
+    }
+    closedir(handle);
+
+    qsort(list->paths, list->count, sizeof(char*), compare_paths);
+}
+
+/* Add one path per non-empty line of a list file */
+static void read_list_file(BatchList *list, const char *source) {
+    FILE *file = strcmp(source, "-") == 0 ? stdin : fopen(source, "r");
+    if (!file) {
+        fprintf(stderr, "Error opening batch list %s: %s\n", source, strerror(errno));
+        exit(1);
+    }
+
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t length;
+    while ((length = getline(&line, &size, file)) != -1) {
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+            line[--length] = '\0';
+        }
+        if (length > 0) {
+            add_batch_path(list, line);
+        }
+    }
+    free(line);
+
+    if (file != stdin) {
+        fclose(file);
+    }
+}
+
+/* File name of path without its directory and .json/.gz/.zst extensions */
+static char* path_stem(const char *path) {
+    const char *base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+
+    char *stem = mem_strdup(MEM_INPUT, *base ? base : "input");
+    if (!stem) {
+        fprintf(stderr, "Memory allocation failed for batch list\n");
+        exit(1);
+    }
+    size_t len = strlen(stem);
+    if (has_suffix(stem, ".gz")) {
+        len -= 3;
+    } else if (has_suffix(stem, ".zst")) {
+        len -= 4;
+    }
+    stem[len] = '\0';
+    if (has_suffix(stem, ".json")) {
+        stem[len - 5] = '\0';
+    }
+    return stem;
+}
+
+static uint64_t hash_name(const char *name) {
+    uint64_t hash = 14695981039346656037ULL;
+    while (*name) {
+        hash = (hash ^ (unsigned char)*name++) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/* Give every file an output name; a stem already taken gets _2, _3, ...
+ * like a repeated table name */
+static void assign_names(BatchList *list) {
+    size_t capacity = 16;
+    while (capacity < (size_t)list->count * 2) {
+        capacity *= 2;
+    }
+    char **taken = (char**)mem_calloc(MEM_INPUT, capacity, sizeof(char*));
+    list->names = (char**)mem_calloc(MEM_INPUT, list->count ? list->count : 1, sizeof(char*));
+    if (!taken || !list->names) {
+        fprintf(stderr, "Memory allocation failed for batch list\n");
+        exit(1);
+    }
+
+    for (int i = 0; i < list->count; i++) {
+        char *stem = path_stem(list->paths[i]);
+        char *name = stem;
+        int suffix = 1;
+        for (;;) {
+            size_t slot = hash_name(name) & (capacity - 1);
+            while (taken[slot] && strcmp(taken[slot], name) != 0) {
+                slot = (slot + 1) & (capacity - 1);
+            }
+            if (!taken[slot]) {
+                taken[slot] = name;
+                break;
+            }
+
+            if (name != stem) {
+                mem_free(MEM_INPUT, name);
+            }
+            name = (char*)mem_alloc(MEM_INPUT, strlen(stem) + 16);
+            if (!name) {
+                fprintf(stderr, "Memory allocation failed for batch list\n");
+                exit(1);
+            }
+            sprintf(name, "%s_%d", stem, ++suffix);
+        }
+        if (name != stem) {
+            mem_free(MEM_INPUT, stem);
+        }
+        list->names[i] = name;
+    }
+
+    /* The names themselves are owned by the list */
+    mem_free(MEM_INPUT, taken);
+}
+
+/* Collect the inputs of a directory or list file */
+BatchList* load_batch_list(const char *source) {
+    BatchList *list = (BatchList*)mem_calloc(MEM_INPUT, 1, sizeof(BatchList));
+    if (!list) {
+        fprintf(stderr, "Memory allocation failed for batch list\n");
+        exit(1);
+    }
+
+    struct stat st;
+    if (strcmp(source, "-") != 0 && stat(source, &st) == 0 && S_ISDIR(st.st_mode)) {
+        list_directory(list, source);
+    } else {
+        read_list_file(list, source);
+    }
+
+    assign_names(list);
+    return list;
+}
+
+void free_batch_list(BatchList *list) {
+    if (!list) {
+        return;
+    }
+    for (int i = 0; i < list->count; i++) {
+        mem_free(MEM_INPUT, list->paths[i]);
+        mem_free(MEM_INPUT, list->names[i]);
+    }
+    mem_free(MEM_INPUT, list->paths);
+    mem_free(MEM_INPUT, list->names);
+    mem_free(MEM_INPUT, list);
+}
+
+/* One worker per online CPU */
+int default_job_count(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return cpus > 0 ? (int)cpus : 1;
+}
+
+/* State shared by the workers of run_batch_jobs */
+typedef struct BatchPool {
+    BatchJob job;
+    void *arg;
+    int count;
+    int next;                 /* Next index to hand out (atomic) */
+    int failed;
+    RunStats stats;           /* Sum of the finished workers' counters */
+    pthread_mutex_t lock;     /* Guards failed and stats */
+} BatchPool;
+
+static void* batch_worker(void *arg) {
+    BatchPool *pool = (BatchPool*)arg;
+    int failed = 0;
+
+    /* Phases of concurrent files are timed with this thread's own CPU clock */
+    stats_use_thread_clock();
+
+    for (;;) {
+        int index = __atomic_fetch_add(&pool->next, 1, __ATOMIC_RELAXED);
+        if (index >= pool->count) {
+            break;
+        }
+        if (pool->job(index, pool->arg) != 0) {
+            failed++;
+        }
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    stats_accumulate(&pool->stats, &run_stats);
+    pool->failed += failed;
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/* Run job for every index on a pool of worker threads */
+int run_batch_jobs(int count, int jobs, BatchJob job, void *arg) {
+    if (count <= 0) {
+        return 0;
+    }
+    if (jobs > count) {
+        jobs = count;
+    }
+    if (jobs < 1) {
+        jobs = 1;
+    }
+
+    BatchPool pool;
+    memset(&pool, 0, sizeof(pool));
+    pool.job = job;
+    pool.arg = arg;
+    pool.count = count;
+    pthread_mutex_init(&pool.lock, NULL);
+
+    pthread_t *threads = (pthread_t*)mem_alloc(MEM_INPUT, jobs * sizeof(pthread_t));
+    if (!threads) {
+        fprintf(stderr, "Memory allocation failed for batch workers\n");
+        exit(1);
+    }
+    for (int i = 0; i < jobs; i++) {
+        int error = pthread_create(&threads[i], NULL, batch_worker, &pool);
+        if (error != 0) {
+            fprintf(stderr, "Error starting batch worker: %s\n", strerror(error));
+            exit(1);
+        }
+    }
+    for (int i = 0; i < jobs; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    mem_free(MEM_INPUT, threads);
+    pthread_mutex_destroy(&pool.lock);
+
+    stats_accumulate(&run_stats, &pool.stats);
+    return pool.failed;
+}
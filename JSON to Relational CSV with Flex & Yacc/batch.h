@@ -0,0 +1,32 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+/* Input files of a --batch run */
+typedef struct BatchList {
+    char **paths;     /* Files in conversion order */
+    char **names;     /* Unique output name of each file (its stem) */
+    int count;
+    int capacity;
+} BatchList;
+
+/* Collect the inputs named by source: every *.json, *.json.gz and
+ * *.json.zst file of a directory, sorted by name, or the paths listed one
+ * per line in a file ("-" reads the list from stdin). Exits with a message
+ * if source cannot be read. */
+BatchList* load_batch_list(const char *source);
+
+void free_batch_list(BatchList *list);
+
+/* Worker threads used when --jobs is not given: one per online CPU */
+int default_job_count(void);
+
+/* Work on input index of a batch; returns nonzero on failure */
+typedef int (*BatchJob)(int index, void *arg);
+
+/* Run job for every index in [0, count) on up to jobs threads, each
+ * taking the next unclaimed index when it finishes one. The threads'
+ * statistics are added to the caller's run_stats. Returns the number of
+ * jobs that failed. */
+int run_batch_jobs(int count, int jobs, BatchJob job, void *arg);
+
+#endif /* BATCH_H */
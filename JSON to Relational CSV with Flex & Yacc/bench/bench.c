@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include "../ast.h"
+#include "../schema.h"
+#include "../csv_gen.h"
+#include "../json_parser.h"
+#include "../stream_io.h"
+#include "../mem.h"
+
+/*
+ * Benchmark harness for json2relcsv.
+ *
+ * Usage: bench_harness [--out-dir DIR] [--parser bison|iterative] FILE...
+ *
+ * Runs the conversion pipeline phase by phase on each FILE and prints one
+ * line per file with the phase times, throughput, peak RSS, the number
+ * of allocations made during the run and how many were never freed.
+ * Allocations are those seen by the memory accounting layer (mem.h).
+ */
+
+/* External declarations */
+extern int yyparse();
+extern FILE *yyin;
+extern void yyrestart(FILE *input_file);
+extern JsonValue *json_root;
+
+/* Monotonic wall clock in milliseconds */
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+/* Peak resident set size of this process in kilobytes */
+static long peak_rss_kb(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+/* Convert one file, timing each phase */
+static int bench_file(const char *path, const char *out_dir, ParserKind parser) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        fprintf(stderr, "Error: cannot stat %s\n", path);
+        return 1;
+    }
+
+    InputStream *input = open_input_stream(path);
+    if (!input) {
+        return 1;
+    }
+    yyin = input->file;
+
+    MemCounters before;
+    mem_counters(MEM_CATEGORY_COUNT, &before);
+    double t0 = now_ms();
+
+    json_root = NULL;
+    if (parser == PARSER_ITERATIVE) {
+        json_root = parse_json_stream(yyin, NULL);
+    } else {
+        yyrestart(yyin);
+        if (yyparse() != 0) {
+            json_root = NULL;
+        }
+    }
+    if (close_input_stream(input) != 0 && json_root) {
+        free_json_value(json_root);
+        json_root = NULL;
+    }
+    if (!json_root) {
+        fprintf(stderr, "Error: failed to parse %s\n", path);
+        return 1;
+    }
+    double t1 = now_ms();
+
+    SchemaContext *schema = create_schema_context(out_dir);
+    detect_schema(schema, json_root);
+    double t2 = now_ms();
+
+    CsvContext *csv = create_csv_context(schema);
+    extract_data(csv, json_root);
+    double t3 = now_ms();
+
+    write_csv_files(csv);
+    double t4 = now_ms();
+
+    free_csv_context(csv);
+    free_schema_context(schema);
+    free_json_value(json_root);
+    json_root = NULL;
+
+    double total = t4 - t0;
+    double mb = st.st_size / (1024.0 * 1024.0);
+    MemCounters after;
+    mem_counters(MEM_CATEGORY_COUNT, &after);
+    unsigned long allocs = after.allocations - before.allocations;
+    unsigned long frees = after.frees - before.frees;
+    printf("%-28s %-9s %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f %10ld %10lu %8lu\n",
+           path, parser == PARSER_ITERATIVE ? "iterative" : "bison", mb, t1 - t0, t2 - t1, t3 - t2, t4 - t3, total,
+           total > 0 ? mb / (total / 1000.0) : 0.0,
+           peak_rss_kb(), allocs, allocs > frees ? allocs - frees : 0);
+    fflush(stdout);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *out_dir = "bench_out";
+    ParserKind parser = PARSER_BISON;
+    int status = 0;
+
+    mem_accounting = 1;
+
+    printf("%-28s %-9s %9s %9s %9s %9s %9s %9s %9s %10s %10s %8s\n",
+           "file", "parser", "MB", "parse_ms", "schema_ms", "extract_ms", "write_ms",
+           "total_ms", "MB/s", "peak_rss_kb", "allocs", "leaked");
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--out-dir") == 0 && i + 1 < argc) {
+            out_dir = argv[++i];
+        } else if (strcmp(argv[i], "--parser") == 0 && i + 1 < argc) {
+            parser = strcmp(argv[++i], "iterative") == 0 ? PARSER_ITERATIVE : PARSER_BISON;
+        } else {
+            status |= bench_file(argv[i], out_dir, parser);
+        }
+    }
+
+    return status;
+}
@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/*
+ * Deterministic synthetic JSON generator for json2relcsv benchmarks.
+ *
+ * Usage: gen_json SHAPE RECORDS [SEED]
+ *
+ * Shapes:
+ *   wide     records with many scalar fields
+ *   deep     records carrying a deeply nested object chain
+ *   long     one long array of small records
+ *   scalars  records holding long arrays of numbers (time series)
+ *   strings  records dominated by long string values
+ *
+ * The same SHAPE, RECORDS and SEED always produce the same bytes.
+ */
+
+#define WIDE_FIELDS 64
+#define DEEP_LEVELS 40
+#define SERIES_LENGTH 256
+#define STRING_FIELDS 8
+
+static uint64_t rng_state;
+
+/* xorshift64* - small, fast and reproducible across platforms */
+static uint64_t next_random(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ULL;
+}
+
+/* Write a random lowercase word of the given length */
+static void put_word(int length) {
+    for (int i = 0; i < length; i++) {
+        putchar('a' + (int)(next_random() % 26));
+    }
+}
+
+/* Write a random scalar value, cycling through all JSON scalar types */
+static void put_scalar(int kind) {
+    switch (kind % 5) {
+        case 0:
+            printf("%d", (int)(next_random() % 100000));
+            break;
+        case 1:
+            printf("%.4f", (double)(next_random() % 1000000) / 97.0);
+            break;
+        case 2:
+            putchar('"');
+            put_word(4 + (int)(next_random() % 12));
+            putchar('"');
+            break;
+        case 3:
+            fputs(next_random() & 1 ? "true" : "false", stdout);
+            break;
+        default:
+            fputs("null", stdout);
+            break;
+    }
+}
+
+static void gen_wide(long records) {
+    printf("{\"records\": [\n");
+    for (long r = 0; r < records; r++) {
+        printf("  {\"rid\": %ld", r);
+        for (int f = 0; f < WIDE_FIELDS; f++) {
+            printf(", \"f%02d\": ", f);
+            put_scalar(f);
+        }
+        printf("}%s\n", r + 1 < records ? "," : "");
+    }
+    printf("]}\n");
+}
+
+static void gen_deep(long records) {
+    printf("{\"records\": [\n");
+    for (long r = 0; r < records; r++) {
+        printf("  {\"rid\": %ld, \"node\": ", r);
+        for (int d = 0; d < DEEP_LEVELS; d++) {
+            printf("{\"level\": %d, \"tag\": \"", d);
+            put_word(6);
+            printf("\", \"node\": ");
+        }
+        printf("null");
+        for (int d = 0; d < DEEP_LEVELS; d++) {
+            putchar('}');
+        }
+        printf("}%s\n", r + 1 < records ? "," : "");
+    }
+    printf("]}\n");
+}
+
+static void gen_long(long records) {
+    printf("{\"source\": \"bench\", \"items\": [\n");
+    for (long r = 0; r < records; r++) {
+        printf("  {\"sku\": \"");
+        put_word(8);
+        printf("\", \"qty\": %d, \"price\": %.2f}%s\n",
+               (int)(next_random() % 50), (double)(next_random() % 100000) / 100.0,
+               r + 1 < records ? "," : "");
+    }
+    printf("]}\n");
+}
+
+static void gen_scalars(long records) {
+    printf("{\"series\": [\n");
+    for (long r = 0; r < records; r++) {
+        printf("  {\"sensor\": %ld, \"samples\": [", r);
+        for (int i = 0; i < SERIES_LENGTH; i++) {
+            printf("%s%.3f", i ? ", " : "", (double)(next_random() % 1000000) / 1000.0);
+        }
+        printf("]}%s\n", r + 1 < records ? "," : "");
+    }
+    printf("]}\n");
+}
+
+static void gen_strings(long records) {
+    printf("{\"documents\": [\n");
+    for (long r = 0; r < records; r++) {
+        printf("  {\"doc\": %ld", r);
+        for (int f = 0; f < STRING_FIELDS; f++) {
+            printf(", \"text%d\": \"", f);
+            int words = 8 + (int)(next_random() % 32);
+            for (int w = 0; w < words; w++) {
+                if (w) {
+                    putchar(w % 7 == 0 ? ',' : ' ');
+                }
+                put_word(2 + (int)(next_random() % 9));
+            }
+            putchar('"');
+        }
+        printf("}%s\n", r + 1 < records ? "," : "");
+    }
+    printf("]}\n");
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s wide|deep|long|scalars|strings RECORDS [SEED]\n", argv[0]);
+        return 1;
+    }
+
+    long records = atol(argv[2]);
+    rng_state = argc > 3 ? strtoull(argv[3], NULL, 10) : 0x9E3779B97F4A7C15ULL;
+    if (rng_state == 0) {
+        rng_state = 1;  /* xorshift must not start at zero */
+    }
+
+    if (strcmp(argv[1], "wide") == 0) {
+        gen_wide(records);
+    } else if (strcmp(argv[1], "deep") == 0) {
+        gen_deep(records);
+    } else if (strcmp(argv[1], "long") == 0) {
+        gen_long(records);
+    } else if (strcmp(argv[1], "scalars") == 0) {
+        gen_scalars(records);
+    } else if (strcmp(argv[1], "strings") == 0) {
+        gen_strings(records);
+    } else {
+        fprintf(stderr, "Unknown shape: %s\n", argv[1]);
+        return 1;
+    }
+
+    return 0;
+}
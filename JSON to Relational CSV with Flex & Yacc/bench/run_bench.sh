@@ -0,0 +1,41 @@
+#!/bin/sh
+# Generate the synthetic benchmark inputs (once) and run the harness on each.
+#
+# Environment:
+#   BENCH_SCALE   multiplier for the record counts (default 1)
+#   BENCH_DATA    directory for generated inputs (default bench/data)
+#   BENCH_OUT     directory for CSV output (default bench/out)
+#   BENCH_PARSERS parser backends to compare (default "bison iterative")
+
+set -e
+cd "$(dirname "$0")"
+
+SCALE=${BENCH_SCALE:-1}
+DATA=${BENCH_DATA:-data}
+OUT=${BENCH_OUT:-out}
+PARSERS=${BENCH_PARSERS:-bison iterative}
+SEED=42
+
+mkdir -p "$DATA" "$OUT"
+
+for spec in wide:2000 deep:500 long:20000 scalars:400 strings:4000; do
+    shape=${spec%%:*}
+    records=$(( ${spec#*:} * SCALE ))
+    file="$DATA/$shape-$records.json"
+    if [ ! -f "$file" ]; then
+        ./gen_json "$shape" "$records" "$SEED" > "$file"
+    fi
+done
+
+first=1
+for file in "$DATA"/*.json; do
+    for parser in $PARSERS; do
+        # The scanner traces every token on stderr; keep only the report
+        if [ $first -eq 1 ]; then
+            ./bench_harness --out-dir "$OUT" --parser "$parser" "$file" 2>/dev/null
+            first=0
+        else
+            ./bench_harness --out-dir "$OUT" --parser "$parser" "$file" 2>/dev/null | tail -n +2
+        fi
+    done
+done
@@ -1,10 +1,13 @@
 #include "csv_gen.h"
+#include "stats.h"
+#include "number_format.h"
+#include "mem.h"
 #include <sys/stat.h>
 #include <errno.h>
 
 /* Create a CSV context for data extraction and generation */
 CsvContext* create_csv_context(SchemaContext *schema) {
-    CsvContext *context = (CsvContext*)malloc(sizeof(CsvContext));
+    CsvContext *context = (CsvContext*)mem_alloc(MEM_ROWS, sizeof(CsvContext));
     if (!context) {
         fprintf(stderr, "Memory allocation failed for CSV context\n");
         exit(1);
@@ -12,7 +15,12 @@ CsvContext* create_csv_context(SchemaContext *schema) {
     
     context->schema = schema;
     context->next_id = 1;
+    context->id_strategy = ID_DENSE;
     context->tables = NULL;  /* Initialize tables list */
+    context->codec = CODEC_NONE;
+    context->pool = NULL;
+    context->dedup = NULL;
+    context->where = NULL;
     
     return context;
 }
@@ -29,7 +37,7 @@ TableData* find_or_create_table_data(CsvContext *context, Table *schema) {
     }
     
     /* Create a new table data structure */
-    table_data = (TableData*)malloc(sizeof(TableData));
+    table_data = (TableData*)mem_alloc(MEM_ROWS, sizeof(TableData));
     if (!table_data) {
         fprintf(stderr, "Memory allocation failed for table data\n");
         exit(1);
@@ -37,8 +45,28 @@ TableData* find_or_create_table_data(CsvContext *context, Table *schema) {
     
     table_data->schema = schema;
     table_data->rows = NULL;
+    table_data->last_row = NULL;
+    table_data->junction = NULL;
+    table_data->next_id = schema->next_id > 0 ? schema->next_id : 1;
     table_data->next = NULL;
     
+    /* Resolve which --where predicates cover this table once */
+    table_data->filters = NULL;
+    table_data->filter_count = 0;
+    Predicate *predicate = context->where;
+    while (predicate) {
+        if (predicate_applies(predicate, schema)) {
+            table_data->filters = (const Predicate**)mem_realloc(MEM_ROWS, table_data->filters,
+                                                             (table_data->filter_count + 1) * sizeof(Predicate*));
+            if (!table_data->filters) {
+                fprintf(stderr, "Memory allocation failed for table data\n");
+                exit(1);
+            }
+            table_data->filters[table_data->filter_count++] = predicate;
+        }
+        predicate = predicate->next;
+    }
+    
     /* Add to the context's table data list */
     if (context->tables == NULL) {
         context->tables = table_data;
@@ -54,8 +82,8 @@ TableData* find_or_create_table_data(CsvContext *context, Table *schema) {
 }
 
 /* Create a row data structure */
-RowData* create_row_data(JsonValue *data, int id, int parent_id, int array_index) {
-    RowData *row = (RowData*)malloc(sizeof(RowData));
+RowData* create_row_data(JsonValue *data, int64_t id, int64_t parent_id, int64_t array_index) {
+    RowData *row = (RowData*)mem_alloc(MEM_ROWS, sizeof(RowData));
     if (!row) {
         fprintf(stderr, "Memory allocation failed for row data\n");
         exit(1);
@@ -65,6 +93,7 @@ RowData* create_row_data(JsonValue *data, int id, int parent_id, int array_index
     row->parent_id = parent_id;
     row->array_index = array_index;
     row->data = data;
+    row->children = NULL;
     row->next = NULL;
     
     return row;
@@ -75,19 +104,195 @@ void add_row_to_table(TableData *table_data, RowData *row) {
     if (table_data->rows == NULL) {
         table_data->rows = row;
     } else {
-        RowData *current = table_data->rows;
-        while (current->next != NULL) {
-            current = current->next;
+        table_data->last_row->next = row;
+    }
+    table_data->last_row = row;
+}
+
+/* Allocate the next row ID from the dense sequence or the table's own.
+ * Extraction runs on one thread and each --batch worker has its own
+ * context, so nothing shares these counters today; the fetch-add only
+ * keeps them safe to share if extraction is ever split across threads. */
+int64_t allocate_row_id(CsvContext *context, TableData *table_data) {
+    return allocate_row_ids(context, table_data, 1);
+}
+
+/* Allocate count consecutive row IDs; returns the first */
+int64_t allocate_row_ids(CsvContext *context, TableData *table_data, int64_t count) {
+    if (context->id_strategy == ID_PER_TABLE) {
+        return __atomic_fetch_add(&table_data->next_id, count, __ATOMIC_RELAXED);
+    }
+    return __atomic_fetch_add(&context->next_id, count, __ATOMIC_RELAXED);
+}
+
+/* Grow a vector so it holds at least needed elements */
+static void* grow_vector(void *items, size_t *capacity, size_t needed, size_t item_size, const char *what) {
+    if (needed <= *capacity) {
+        return items;
+    }
+    size_t new_capacity = *capacity ? *capacity : 64;
+    while (new_capacity < needed) {
+        new_capacity *= 2;
+    }
+    items = mem_realloc(MEM_ROWS, items, new_capacity * item_size);
+    if (!items) {
+        fprintf(stderr, "Memory allocation failed for %s\n", what);
+        exit(1);
+    }
+    *capacity = new_capacity;
+    return items;
+}
+
+/* An object, or an array of objects, whose members are still being visited.
+ * Extraction uses an explicit stack of these so depth is bounded only by
+ * memory; IDs are assigned in the same pre-order as a recursive walk. */
+typedef struct ExtractFrame {
+    JsonType type;         /* JSON_OBJECT or JSON_ARRAY */
+    TableData *table_data; /* Object: its table data; array: the parent's */
+    int64_t id;            /* Object: its row ID; array: the parent row ID */
+    RowData *row;          /* Object: its row */
+    KeyValuePair *pair;    /* Object: next pair to visit */
+    ArrayElement *elem;    /* Array: next element to visit */
+    int64_t index;         /* Array: index of the next element */
+} ExtractFrame;
+
+/* Explicit traversal stack */
+typedef struct ExtractWalk {
+    ExtractFrame *frames;
+    int depth;
+    int capacity;
+} ExtractWalk;
+
+/* Push a frame and return it */
+static ExtractFrame* push_extract_frame(ExtractWalk *walk, JsonType type, TableData *table_data, int64_t id) {
+    if (walk->depth == walk->capacity) {
+        walk->capacity = walk->capacity ? walk->capacity * 2 : 32;
+        walk->frames = (ExtractFrame*)mem_realloc(MEM_ROWS, walk->frames, walk->capacity * sizeof(ExtractFrame));
+        if (!walk->frames) {
+            fprintf(stderr, "Memory allocation failed for extraction stack\n");
+            exit(1);
         }
-        current->next = row;
     }
+
+    ExtractFrame *frame = &walk->frames[walk->depth++];
+    frame->type = type;
+    frame->table_data = table_data;
+    frame->id = id;
+    frame->row = NULL;
+    frame->pair = NULL;
+    frame->elem = NULL;
+    frame->index = 0;
+    return frame;
 }
 
-/* Process object data and extract rows */
-void process_object_data(CsvContext *context, JsonValue *object, TableData *parent_data, int parent_id, int array_index) {
-    /* Mark parent_data as unused to avoid warning */
-    (void)parent_data;
+/* Emit junction rows for an array of scalars */
+static void extract_scalar_array(CsvContext *context, JsonValue *array, int64_t parent_id, const char *array_key) {
+    char signature[256];
+    sprintf(signature, "junction:%s", array_key);
+    
+    /* Find the junction table schema */
+    Table *junction_schema = find_table_by_signature(context->schema, signature);
+    if (!junction_schema) {
+        fprintf(stderr, "Error: Junction table schema not found for array\n");
+        exit(1);
+    }
+    
+    /* Find or create the junction table data */
+    TableData *junction_data = find_or_create_table_data(context, junction_schema);
+    if (!junction_data->junction) {
+        junction_data->junction = (JunctionData*)mem_calloc(MEM_ROWS, 1, sizeof(JunctionData));
+        if (!junction_data->junction) {
+            fprintf(stderr, "Memory allocation failed for junction data\n");
+            exit(1);
+        }
+    }
+    JunctionData *junction = junction_data->junction;
+    
+    /* Count the elements so IDs and vector space are reserved at once */
+    size_t count = 0;
+    ArrayElement *elem = array->value.array_head;
+    while (elem) {
+        count++;
+        elem = elem->next;
+    }
+    if (count == 0) {
+        return;
+    }
+    
+    size_t needed = junction->value_count + count;
+    if (needed > junction->value_capacity) {
+        size_t capacity = junction->value_capacity;
+        junction->values = (ScalarValue*)grow_vector(junction->values, &capacity, needed,
+                                                     sizeof(ScalarValue), "junction values");
+        junction->types = (unsigned char*)grow_vector(junction->types, &junction->value_capacity, needed,
+                                                      sizeof(unsigned char), "junction values");
+    }
+    
+    junction->runs = (JunctionRun*)grow_vector(junction->runs, &junction->run_capacity, junction->run_count + 1,
+                                               sizeof(JunctionRun), "junction runs");
+    JunctionRun *run = &junction->runs[junction->run_count++];
+    run->first_id = allocate_row_ids(context, junction_data, (int64_t)count);
+    run->parent_id = parent_id;
+    run->start = junction->value_count;
+    run->count = count;
+    
+    /* Copy each scalar into the typed vectors */
+    unsigned char *types = junction->types + junction->value_count;
+    ScalarValue *values = junction->values + junction->value_count;
+    elem = array->value.array_head;
+    while (elem) {
+        JsonValue *value = &elem->value;
+        *types = (unsigned char)value->type;
+        switch (value->type) {
+            case JSON_STRING:
+                values->string = json_string_text(value);
+                break;
+            case JSON_NUMBER:
+                values->number = value->value.number_value;
+                break;
+            case JSON_BOOLEAN:
+                values->boolean = value->value.boolean_value;
+                break;
+            default:
+                /* Nulls (and nested containers) are written as empty fields */
+                *types = JSON_NULL;
+                break;
+        }
+        types++;
+        values++;
+        elem = elem->next;
+    }
+    junction->value_count = needed;
+}
+
+/* Point a row's <key>_id column at a nested object's row */
+static void add_child_ref(RowData *row, const char *key, int64_t id) {
+    ChildRef *ref = (ChildRef*)mem_alloc(MEM_ROWS, sizeof(ChildRef));
+    if (!ref) {
+        fprintf(stderr, "Memory allocation failed for child reference\n");
+        exit(1);
+    }
+    ref->key = key;
+    ref->id = id;
+    ref->next = NULL;
     
+    /* Keep source order so a repeated key resolves like its value columns */
+    if (!row->children) {
+        row->children = ref;
+    } else {
+        ChildRef *last = row->children;
+        while (last->next) {
+            last = last->next;
+        }
+        last->next = ref;
+    }
+}
+
+/* Emit the row for an object and queue its members for visiting.
+ * A nested object (parent_row set) is referenced from parent_row's
+ * <key>_id column; array elements instead carry parent_id and their index. */
+static void enter_object_data(CsvContext *context, ExtractWalk *walk, JsonValue *object, int64_t parent_id, int64_t array_index,
+                              RowData *parent_row, const char *key) {
     if (object->type != JSON_OBJECT) {
         return;
     }
@@ -99,45 +304,57 @@ void process_object_data(CsvContext *context, JsonValue *object, TableData *pare
     Table *table_schema = find_table_by_signature(context->schema, signature);
     if (!table_schema) {
         fprintf(stderr, "Error: Table schema not found for object\n");
-        free(signature);
+        mem_free(MEM_SCHEMA, signature);
         exit(1);
     }
+    mem_free(MEM_SCHEMA, signature);
     
     /* Find or create the table data */
     TableData *table_data = find_or_create_table_data(context, table_schema);
     
+    /* A row rejected by --where is dropped with everything nested in it */
+    for (int i = 0; i < table_data->filter_count; i++) {
+        if (!evaluate_predicate(table_data->filters[i], object)) {
+            run_stats.rows_filtered++;
+            return;
+        }
+    }
+    
+    /* With --dedup an object equal to one already emitted reuses its row;
+     * its subtree was extracted with that row and is skipped. Array
+     * elements are never shared since their rows carry parent and index. */
+    uint64_t hash = 0;
+    if (context->dedup && parent_row) {
+        hash = dedup_hash(context->dedup, object);
+        int64_t existing = dedup_find(context->dedup, table_schema, object, hash);
+        if (existing) {
+            add_child_ref(parent_row, key, existing);
+            run_stats.rows_deduplicated++;
+            return;
+        }
+    }
+    
     /* Create a row for this object */
-    int id = context->next_id++;
+    int64_t id = allocate_row_id(context, table_data);
     RowData *row = create_row_data(object, id, parent_id, array_index);
     add_row_to_table(table_data, row);
     
-    /* Process all key-value pairs */
-    KeyValuePair *pair = object->value.object_head;
-    while (pair) {
-        switch (pair->value->type) {
-            case JSON_OBJECT:
-                /* Recursive call for nested objects */
-                process_object_data(context, pair->value, table_data, id, -1);
-                break;
-                
-            case JSON_ARRAY:
-                /* Process arrays */
-                process_array_data(context, pair->value, table_data, id, pair->key);
-                break;
-                
-            default:
-                /* Scalar values are handled later when writing the CSV */
-                break;
+    if (parent_row) {
+        add_child_ref(parent_row, key, id);
+        if (context->dedup) {
+            dedup_insert(context->dedup, table_schema, object, hash, id);
         }
-        
-        pair = pair->next;
     }
     
-    free(signature);
+    /* Scalar values are handled later when writing the CSV; nested
+       objects and arrays are visited from the traversal loop */
+    ExtractFrame *frame = push_extract_frame(walk, JSON_OBJECT, table_data, id);
+    frame->row = row;
+    frame->pair = object->value.object_head;
 }
 
-/* Process array data and extract rows */
-void process_array_data(CsvContext *context, JsonValue *array, TableData *parent_data, int parent_id, const char *array_key) {
+/* Handle an array found under a key of the object with row ID parent_id */
+static void enter_array_data(CsvContext *context, ExtractWalk *walk, JsonValue *array, TableData *parent_data, int64_t parent_id, const char *array_key) {
     if (array->type != JSON_ARRAY) {
         return;
     }
@@ -148,43 +365,89 @@ void process_array_data(CsvContext *context, JsonValue *array, TableData *parent
         return;  /* Empty array */
     }
     
-    if (elem->value->type == JSON_OBJECT) {
+    if (elem->value.type == JSON_OBJECT) {
         /* Array of objects - create rows in the child table */
-        int index = 0;
-        while (elem) {
-            process_object_data(context, elem->value, parent_data, parent_id, index++);
-            elem = elem->next;
-        }
+        ExtractFrame *frame = push_extract_frame(walk, JSON_ARRAY, parent_data, parent_id);
+        frame->elem = elem;
     } else {
         /* Array of scalars - create rows in the junction table */
-        char signature[256];
-        sprintf(signature, "junction:%s", array_key);
-        
-        /* Find the junction table schema */
-        Table *junction_schema = find_table_by_signature(context->schema, signature);
-        if (!junction_schema) {
-            fprintf(stderr, "Error: Junction table schema not found for array\n");
-            exit(1);
-        }
-        
-        /* Find or create the junction table data */
-        TableData *junction_data = find_or_create_table_data(context, junction_schema);
+        extract_scalar_array(context, array, parent_id, array_key);
+    }
+}
+
+/* Visit queued members until the stack is empty */
+static void run_extract_walk(CsvContext *context, ExtractWalk *walk) {
+    while (walk->depth > 0) {
+        ExtractFrame *top = &walk->frames[walk->depth - 1];
         
-        /* Add a row for each scalar in the array */
-        int index = 0;
-        while (elem) {
-            /* Create a row with a reference to the scalar value */
-            int id = context->next_id++;
-            RowData *row = create_row_data(elem->value, id, parent_id, index++);
-            add_row_to_table(junction_data, row);
+        if (top->type == JSON_OBJECT) {
+            KeyValuePair *pair = top->pair;
+            if (!pair) {
+                walk->depth--;
+                continue;
+            }
+            top->pair = pair->next;
             
-            elem = elem->next;
+            switch (pair->value.type) {
+                case JSON_OBJECT:
+                    enter_object_data(context, walk, &pair->value, top->id, -1, top->row, pair->key);
+                    break;
+                    
+                case JSON_ARRAY:
+                    enter_array_data(context, walk, &pair->value, top->table_data, top->id, pair->key);
+                    break;
+                    
+                default:
+                    /* Scalar values are handled later when writing the CSV */
+                    break;
+            }
+        } else {
+            ArrayElement *elem = top->elem;
+            if (!elem) {
+                walk->depth--;
+                continue;
+            }
+            top->elem = elem->next;
+            
+            int64_t index = top->index++;
+            enter_object_data(context, walk, &elem->value, top->id, index, NULL, NULL);
         }
     }
+    
+    mem_free(MEM_ROWS, walk->frames);
+    walk->frames = NULL;
+    walk->capacity = 0;
+}
+
+/* Process object data and extract rows */
+void process_object_data(CsvContext *context, JsonValue *object, TableData *parent_data, int64_t parent_id, int64_t array_index) {
+    /* Mark parent_data as unused to avoid warning */
+    (void)parent_data;
+    
+    ExtractWalk walk = {NULL, 0, 0};
+    enter_object_data(context, &walk, object, parent_id, array_index, NULL, NULL);
+    run_extract_walk(context, &walk);
+}
+
+/* Process array data and extract rows */
+void process_array_data(CsvContext *context, JsonValue *array, TableData *parent_data, int64_t parent_id, const char *array_key) {
+    ExtractWalk walk = {NULL, 0, 0};
+    enter_array_data(context, &walk, array, parent_data, parent_id, array_key);
+    run_extract_walk(context, &walk);
 }
 
 /* Extract data from the AST into the CSV context */
 void extract_data(CsvContext *context, JsonValue *root) {
+    if (root->type == JSON_ARRAY) {
+        /* Each element of a top-level array is a root record */
+        ArrayElement *elem = root->value.array_head;
+        while (elem) {
+            process_object_data(context, &elem->value, NULL, 0, -1);
+            elem = elem->next;
+        }
+        return;
+    }
+
     /* Process the root object */
     process_object_data(context, root, NULL, 0, -1);
 }
@@ -239,36 +502,264 @@ char* escape_csv_field(const char *field) {
     return escaped;
 }
 
-/* Write a single CSV file for a table */
-void write_csv_file(TableData *table_data, const char *output_dir) {
-    if (!table_data || !table_data->schema) {
+/* Bytes of formatted CSV collected before handing a chunk to the writer */
+#define CSV_FLUSH_SIZE (1 << 20)
+
+static void csv_buffer_putc(CsvBuffer *buffer, char c) {
+    csv_buffer_reserve(buffer, 1);
+    buffer->data[buffer->length++] = c;
+}
+
+/* Append a decimal integer */
+static void csv_buffer_int(CsvBuffer *buffer, int64_t value) {
+    csv_buffer_reserve(buffer, NUMBER_FORMAT_MAX);
+    buffer->length += format_int64(value, buffer->data + buffer->length);
+}
+
+/* Append a field with CSV quoting, without an intermediate copy */
+static void csv_buffer_field(CsvBuffer *buffer, const char *field) {
+    if (!field) {
+        return;
+    }
+
+    size_t len = strlen(field);
+    size_t quotes_count = 0;
+    int needs_quotes = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (field[i] == '"') {
+            quotes_count++;
+            needs_quotes = 1;
+        } else if (field[i] == ',' || field[i] == '\n' || field[i] == '\r') {
+            needs_quotes = 1;
+        }
+    }
+
+    if (!needs_quotes) {
+        csv_buffer_append(buffer, field, len);
         return;
     }
+
+    csv_buffer_reserve(buffer, len + quotes_count + 2);
+    char *out = buffer->data + buffer->length;
+    *out++ = '"';
+    for (size_t i = 0; i < len; i++) {
+        if (field[i] == '"') {
+            *out++ = '"';  /* Double the quote */
+        }
+        *out++ = field[i];
+    }
+    *out++ = '"';
+    buffer->length = out - buffer->data;
+}
+
+/* Append a typed scalar formatted for a column */
+static void csv_buffer_scalar(CsvBuffer *buffer, JsonType json_type, const ScalarValue *value, ColumnType type) {
+    switch (json_type) {
+        case JSON_STRING:
+            csv_buffer_field(buffer, value->string);
+            break;
+
+        case JSON_NUMBER:
+            /* Integers of an integer column are written directly; other
+             * numbers (also ones a loaded schema declared integer) get the
+             * shortest digits that round-trip exactly */
+            if (type == COL_INTEGER && number_is_exact_integer(value->number)) {
+                csv_buffer_int(buffer, (int64_t)value->number);
+            } else {
+                csv_buffer_reserve(buffer, NUMBER_FORMAT_MAX);
+                buffer->length += format_double(value->number, buffer->data + buffer->length);
+            }
+            break;
+
+        case JSON_BOOLEAN:
+            if (value->boolean) {
+                csv_buffer_append(buffer, "true", 4);
+            } else {
+                csv_buffer_append(buffer, "false", 5);
+            }
+            break;
+
+        case JSON_NULL:
+            /* Empty field for null */
+            break;
+
+        default:
+            /* Shouldn't happen for scalar columns */
+            break;
+    }
+}
+
+/* Append a scalar AST value formatted for a column */
+static void csv_buffer_value(CsvBuffer *buffer, JsonValue *value, ColumnType type) {
+    ScalarValue scalar;
+    switch (value->type) {
+        case JSON_STRING:
+            scalar.string = json_string_text(value);
+            break;
+        case JSON_NUMBER:
+            scalar.number = value->value.number_value;
+            break;
+        case JSON_BOOLEAN:
+            scalar.boolean = value->value.boolean_value;
+            break;
+        default:
+            scalar.string = NULL;
+            break;
+    }
+    csv_buffer_scalar(buffer, value->type, &scalar, type);
+}
+
+/* What a column of a junction table file holds */
+typedef enum {
+    JUNCTION_ID,
+    JUNCTION_PARENT,
+    JUNCTION_INDEX,
+    JUNCTION_VALUE,
+    JUNCTION_EMPTY
+} JunctionField;
+
+typedef struct JunctionColumn {
+    JunctionField field;
+    ColumnType type;
+} JunctionColumn;
+
+/* Write the rows of a scalar-array table straight from its typed vectors */
+static void write_junction_rows(CsvContext *context, PooledFile *out, TableData *table_data, int segment) {
+    JunctionData *junction = table_data->junction;
+    CsvBuffer *buffer = &out->buffer;
+    
+    /* Resolve the columns of this file once rather than per row */
+    int column_count = 0;
+    Column *col = table_data->schema->columns;
+    while (col) {
+        column_count++;
+        col = col->next;
+    }
+    JunctionColumn *columns = (JunctionColumn*)mem_alloc(MEM_ROWS, (column_count + 1) * sizeof(JunctionColumn));
+    if (!columns) {
+        fprintf(stderr, "Memory allocation failed for junction columns\n");
+        exit(1);
+    }
+    
+    int count = 0;
+    if (segment > 0) {
+        columns[count].field = JUNCTION_ID;  /* Sidecar key */
+        columns[count++].type = COL_ID;
+    }
+    col = table_data->schema->columns;
+    while (col) {
+        if (col->segment == segment) {
+            JunctionField field;
+            if (col->type == COL_ID) {
+                field = JUNCTION_ID;
+            } else if (col->type == COL_INDEX || (col->type == COL_FOREIGN_KEY && strcmp(col->name, "seq") == 0)) {
+                field = JUNCTION_INDEX;
+            } else if (col->type == COL_FOREIGN_KEY) {
+                field = JUNCTION_PARENT;
+            } else if (strcmp(col->name, "value") == 0) {
+                field = JUNCTION_VALUE;
+            } else {
+                field = JUNCTION_EMPTY;
+            }
+            columns[count].field = field;
+            columns[count++].type = col->type;
+        }
+        col = col->next;
+    }
+    
+    for (size_t r = 0; r < junction->run_count; r++) {
+        JunctionRun *run = &junction->runs[r];
+        for (size_t i = 0; i < run->count; i++) {
+            size_t v = run->start + i;
+            for (int c = 0; c < count; c++) {
+                if (c > 0) {
+                    csv_buffer_putc(buffer, ',');
+                }
+                switch (columns[c].field) {
+                    case JUNCTION_ID:
+                        csv_buffer_int(buffer, run->first_id + (int64_t)i);
+                        break;
+                    case JUNCTION_PARENT:
+                        csv_buffer_int(buffer, run->parent_id);
+                        break;
+                    case JUNCTION_INDEX:
+                        csv_buffer_int(buffer, (int64_t)i);
+                        break;
+                    case JUNCTION_VALUE:
+                        csv_buffer_scalar(buffer, (JsonType)junction->types[v], &junction->values[v], columns[c].type);
+                        break;
+                    case JUNCTION_EMPTY:
+                        break;
+                }
+            }
+            csv_buffer_putc(buffer, '\n');
+            
+            if (buffer->length >= CSV_FLUSH_SIZE) {
+                file_pool_flush(context->pool, out);
+            }
+        }
+        if (segment == 0) {
+            run_stats.rows += run->count;
+        }
+    }
     
+    mem_free(MEM_ROWS, columns);
+}
+
+/* Write one file of a table: the main CSV (segment 0), or a sidecar keyed
+ * by row id holding the columns an --append run added to a stored table */
+static void write_csv_segment(CsvContext *context, TableData *table_data, int segment) {
     /* Create the output filename */
     char filename[512];
-    sprintf(filename, "%s/%s.csv", output_dir, table_data->schema->name);
-    
-    /* Open the file for writing */
-    FILE *file = fopen(filename, "w");
-    if (!file) {
-        fprintf(stderr, "Error opening file %s for writing: %s\n", filename, strerror(errno));
-        exit(1);
+    if (segment == 0) {
+        snprintf(filename, sizeof(filename), "%s/%s.csv%s", context->schema->output_dir,
+                 table_data->schema->name, codec_extension(context->codec));
+    } else {
+        snprintf(filename, sizeof(filename), "%s/%s.ext%d.csv%s", context->schema->output_dir,
+                 table_data->schema->name, segment, codec_extension(context->codec));
     }
     
+    /* Files of stored tables get the new rows appended, without a header */
+    struct stat st;
+    int append = table_data->schema->stored && stat(filename, &st) == 0 && st.st_size > 0;
+    
+    /* Rows are formatted into the file's pool buffer; the file is opened
+     * when the first full buffer is written out */
+    PooledFile *out = file_pool_add(context->pool, filename, append);
+    CsvBuffer *buffer = &out->buffer;
+    
     /* Write the header row */
     Column *col = table_data->schema->columns;
     int first_col = 1;
     
-    while (col) {
-        if (!first_col) {
-            fprintf(file, ",");
+    if (!append) {
+        if (segment > 0) {
+            csv_buffer_append(buffer, "id", 2);
+            first_col = 0;
         }
-        fprintf(file, "%s", col->name);
-        first_col = 0;
-        col = col->next;
+        while (col) {
+            if (col->segment == segment) {
+                if (!first_col) {
+                    csv_buffer_putc(buffer, ',');
+                }
+                csv_buffer_append(buffer, col->name, strlen(col->name));
+                first_col = 0;
+            }
+            col = col->next;
+        }
+        csv_buffer_putc(buffer, '\n');
+    }
+    
+    /* Scalar-array tables keep their rows in typed vectors */
+    if (table_data->junction) {
+        write_junction_rows(context, out, table_data, segment);
+    }
+    
+    /* The parent table's key column; other foreign keys point at nested objects */
+    char parent_fk[256] = "";
+    if (table_data->schema->parent_table) {
+        snprintf(parent_fk, sizeof(parent_fk), "%s_id", table_data->schema->parent_table);
     }
-    fprintf(file, "\n");
     
     /* Write each data row */
     RowData *row = table_data->rows;
@@ -277,104 +768,67 @@ void write_csv_file(TableData *table_data, const char *output_dir) {
         col = table_data->schema->columns;
         first_col = 1;
         
+        if (segment > 0) {
+            csv_buffer_int(buffer, row->id);
+            first_col = 0;
+        }
+        
         while (col) {
+            if (col->segment != segment) {
+                col = col->next;
+                continue;
+            }
             if (!first_col) {
-                fprintf(file, ",");
+                csv_buffer_putc(buffer, ',');
             }
             
             /* Output based on column type */
             switch (col->type) {
                 case COL_ID:
-                    fprintf(file, "%d", row->id);
+                    csv_buffer_int(buffer, row->id);
                     break;
                     
                 case COL_FOREIGN_KEY:
                     if (strcmp(col->name, "seq") == 0) {
-                        fprintf(file, "%d", row->array_index);
+                        csv_buffer_int(buffer, row->array_index);
+                    } else if (strcmp(col->name, parent_fk) == 0) {
+                        csv_buffer_int(buffer, row->parent_id);
                     } else {
-                        fprintf(file, "%d", row->parent_id);
+                        /* <key>_id of a nested object; empty when it was null or absent */
+                        size_t key_length = strlen(col->name) - 3;
+                        ChildRef *ref = row->children;
+                        while (ref) {
+                            if (strncmp(ref->key, col->name, key_length) == 0 && ref->key[key_length] == '\0') {
+                                csv_buffer_int(buffer, ref->id);
+                                break;
+                            }
+                            ref = ref->next;
+                        }
                     }
                     break;
                     
                 case COL_INDEX:
-                    fprintf(file, "%d", row->array_index);
+                    csv_buffer_int(buffer, row->array_index);
                     break;
                     
                 case COL_STRING:
                 case COL_NUMBER:
+                case COL_INTEGER:
                 case COL_BOOLEAN:
                 case COL_NULL:
                     /* Find the value for this column in the row data */
                     if (row->data->type == JSON_OBJECT) {
                         KeyValuePair *pair = row->data->value.object_head;
-                        int found = 0;
-                        
                         while (pair) {
                             if (strcmp(pair->key, col->name) == 0) {
-                                found = 1;
-                                
-                                /* Output based on value type */
-                                switch (pair->value->type) {
-                                    case JSON_STRING: {
-                                        char *escaped = escape_csv_field(pair->value->value.string_value);
-                                        fprintf(file, "%s", escaped);
-                                        free(escaped);
-                                        break;
-                                    }
-                                    
-                                    case JSON_NUMBER:
-                                        fprintf(file, "%g", pair->value->value.number_value);
-                                        break;
-                                        
-                                    case JSON_BOOLEAN:
-                                        fprintf(file, "%s", pair->value->value.boolean_value ? "true" : "false");
-                                        break;
-                                        
-                                    case JSON_NULL:
-                                        /* Empty field for null */
-                                        break;
-                                        
-                                    default:
-                                        /* Shouldn't happen for scalar columns */
-                                        break;
-                                }
-                                
+                                csv_buffer_value(buffer, &pair->value, col->type);
                                 break;
                             }
-                            
                             pair = pair->next;
                         }
-                        
-                        if (!found && col->name[0] != '_') {
-                            /* Column not found in this row */
-                            /* Empty field (but should not happen with proper schema) */
-                        }
-                    } else if (row->data->type != JSON_OBJECT && strcmp(col->name, "value") == 0) {
+                    } else if (strcmp(col->name, "value") == 0) {
                         /* For junction tables, output the scalar value */
-                        switch (row->data->type) {
-                            case JSON_STRING: {
-                                char *escaped = escape_csv_field(row->data->value.string_value);
-                                fprintf(file, "%s", escaped);
-                                free(escaped);
-                                break;
-                            }
-                            
-                            case JSON_NUMBER:
-                                fprintf(file, "%g", row->data->value.number_value);
-                                break;
-                                
-                            case JSON_BOOLEAN:
-                                fprintf(file, "%s", row->data->value.boolean_value ? "true" : "false");
-                                break;
-                                
-                            case JSON_NULL:
-                                /* Empty field for null */
-                                break;
-                                
-                            default:
-                                /* Shouldn't happen for scalar values */
-                                break;
-                        }
+                        csv_buffer_value(buffer, row->data, col->type);
                     }
                     break;
             }
@@ -383,11 +837,40 @@ void write_csv_file(TableData *table_data, const char *output_dir) {
             col = col->next;
         }
         
-        fprintf(file, "\n");
+        csv_buffer_putc(buffer, '\n');
+        if (segment == 0) {
+            run_stats.rows++;
+        }
+        if (buffer->length >= CSV_FLUSH_SIZE) {
+            file_pool_flush(context->pool, out);
+        }
         row = row->next;
     }
     
-    fclose(file);
+    /* Finish the file and account for it in the run statistics */
+    file_pool_finish(context->pool, out);
+    run_stats.bytes_written += out->bytes;
+}
+
+/* Write the CSV file of a table, plus any sidecar files */
+void write_csv_file(CsvContext *context, TableData *table_data) {
+    if (!table_data || !table_data->schema) {
+        return;
+    }
+    
+    int segments = 1;
+    Column *col = table_data->schema->columns;
+    while (col) {
+        if (col->segment >= segments) {
+            segments = col->segment + 1;
+        }
+        col = col->next;
+    }
+    
+    for (int segment = 0; segment < segments; segment++) {
+        write_csv_segment(context, table_data, segment);
+    }
+    run_stats.tables++;
 }
 
 /* Write all CSV files */
@@ -402,12 +885,23 @@ void write_csv_files(CsvContext *context) {
         }
     }
     
+    /* Plain files share one async writer, so formatting the next table
+     * overlaps the writes of earlier ones */
+    context->pool = create_file_pool(context->codec);
+    
     /* Write a file for each table */
     TableData *table_data = context->tables;
     while (table_data) {
-        write_csv_file(table_data, context->schema->output_dir);
+        write_csv_file(context, table_data);
         table_data = table_data->next;
     }
+    
+    /* Wait for the queued writes to reach the files */
+    int status = free_file_pool(context->pool);
+    context->pool = NULL;
+    if (status != 0) {
+        exit(1);
+    }
 }
 
 /* Generate all CSV files from the JSON AST */
@@ -440,13 +934,28 @@ void free_csv_context(CsvContext *context) {
         RowData *row = table_data->rows;
         while (row) {
             RowData *next_row = row->next;
-            free(row);
+            ChildRef *ref = row->children;
+            while (ref) {
+                ChildRef *next_ref = ref->next;
+                mem_free(MEM_ROWS, ref);
+                ref = next_ref;
+            }
+            mem_free(MEM_ROWS, row);
             row = next_row;
         }
         
-        free(table_data);
+        if (table_data->junction) {
+            mem_free(MEM_ROWS, table_data->junction->runs);
+            mem_free(MEM_ROWS, table_data->junction->types);
+            mem_free(MEM_ROWS, table_data->junction->values);
+            mem_free(MEM_ROWS, table_data->junction);
+        }
+        
+        mem_free(MEM_ROWS, table_data->filters);
+        mem_free(MEM_ROWS, table_data);
         table_data = next_table;
     }
     
-    free(context);
+    free_dedup_index(context->dedup);
+    mem_free(MEM_ROWS, context);
 }
@@ -1,7 +1,12 @@
 #ifndef CSV_GEN_H
 #define CSV_GEN_H
 
+#include <stdint.h>
 #include "schema.h"
+#include "stream_io.h"
+#include "file_pool.h"
+#include "dedup.h"
+#include "predicate.h"
 
 /* Forward declarations */
 typedef struct TableData TableData;
@@ -10,23 +15,68 @@ typedef struct RowData RowData;
 /* CSV generation context */
 typedef struct CsvContext {
     SchemaContext *schema;
-    int next_id;  /* For generating sequential IDs */
+    int64_t next_id;  /* Next ID of the dense sequence */
+    IdStrategy id_strategy;  /* One sequence for all tables, or one per table */
     TableData *tables;  /* List of table data */
+    Codec codec;  /* Compression for output files */
+    FilePool *pool;  /* Output files while writing */
+    DedupIndex *dedup;  /* Emitted nested objects when --dedup is on, else NULL */
+    Predicate *where;  /* --where filters; rows failing one are not extracted */
 } CsvContext;
 
+/* A nested object a row points to through its <key>_id column */
+typedef struct ChildRef {
+    const char *key;  /* Owned by the AST */
+    int64_t id;
+    struct ChildRef *next;
+} ChildRef;
+
 /* Row data for CSV output */
 struct RowData {
-    int id;
-    int parent_id;
-    int array_index;
+    int64_t id;
+    int64_t parent_id;
+    int64_t array_index;
     JsonValue *data;
+    ChildRef *children;  /* Nested objects under this row's keys */
     RowData *next;
 };
 
+/* One scalar array element, typed by the tag stored next to it */
+typedef union ScalarValue {
+    double number;
+    const char *string;  /* Owned by the AST */
+    int boolean;
+} ScalarValue;
+
+/* The elements of one source array in a junction table. Its rows have
+ * consecutive IDs first_id, first_id + 1, ... and indexes 0, 1, ... */
+typedef struct JunctionRun {
+    int64_t first_id;
+    int64_t parent_id;
+    size_t start;  /* Position of the first element in the value vectors */
+    size_t count;
+} JunctionRun;
+
+/* Junction table rows stored column-wise instead of as RowData */
+typedef struct JunctionData {
+    JunctionRun *runs;
+    size_t run_count;
+    size_t run_capacity;
+    unsigned char *types;  /* JsonType of each element */
+    ScalarValue *values;
+    size_t value_count;
+    size_t value_capacity;
+} JunctionData;
+
 /* Table data for CSV output */
 struct TableData {
     Table *schema;
     RowData *rows;
+    JunctionData *junction;  /* Rows of a scalar-array table, else NULL */
+    RowData *last_row;  /* Tail of rows, for constant-time appends */
+    int64_t next_id;  /* Next ID of the table's own sequence */
+    const Predicate **filters;  /* The --where predicates that apply to this table */
+    int filter_count;
     TableData *next;
 };
 
@@ -38,12 +88,14 @@ void write_csv_files(CsvContext *context);
 void free_csv_context(CsvContext *context);
 
 /* Helper functions */
-void process_object_data(CsvContext *context, JsonValue *object, TableData *parent_data, int parent_id, int array_index);
-void process_array_data(CsvContext *context, JsonValue *array, TableData *parent_data, int parent_id, const char *array_key);
+void process_object_data(CsvContext *context, JsonValue *object, TableData *parent_data, int64_t parent_id, int64_t array_index);
+void process_array_data(CsvContext *context, JsonValue *array, TableData *parent_data, int64_t parent_id, const char *array_key);
 TableData* find_or_create_table_data(CsvContext *context, Table *schema);
-RowData* create_row_data(JsonValue *data, int id, int parent_id, int array_index);
+RowData* create_row_data(JsonValue *data, int64_t id, int64_t parent_id, int64_t array_index);
+int64_t allocate_row_id(CsvContext *context, TableData *table_data);
+int64_t allocate_row_ids(CsvContext *context, TableData *table_data, int64_t count);
 void add_row_to_table(TableData *table_data, RowData *row);
-void write_csv_file(TableData *table_data, const char *output_dir);
+void write_csv_file(CsvContext *context, TableData *table_data);
 char* escape_csv_field(const char *field);
 
 #endif /* CSV_GEN_H */
@@ -0,0 +1,149 @@
+#include "dedup.h"
+#include "mem.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Initial number of slots */
+#define DEDUP_INITIAL_CAPACITY 1024
+
+DedupIndex* create_dedup_index(void) {
+    DedupIndex *index = (DedupIndex*)mem_calloc(MEM_ROWS, 1, sizeof(DedupIndex));
+    if (!index) {
+        fprintf(stderr, "Memory allocation failed for dedup index\n");
+        exit(1);
+    }
+    index->capacity = DEDUP_INITIAL_CAPACITY;
+    index->entries = (DedupEntry*)mem_calloc(MEM_ROWS, index->capacity, sizeof(DedupEntry));
+    if (!index->entries) {
+        fprintf(stderr, "Memory allocation failed for dedup index\n");
+        exit(1);
+    }
+    return index;
+}
+
+static size_t hash_pointer(const void *ptr) {
+    uint64_t key = (uint64_t)(uintptr_t)ptr;
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (size_t)key;
+}
+
+/* Record the hash of a nested object; called by hash_json_tree */
+static void remember_hash(void *arg, JsonValue *object, uint64_t hash) {
+    DedupIndex *index = (DedupIndex*)arg;
+    if ((index->hash_count + 1) * 4 > index->hash_capacity * 3) {
+        size_t capacity = index->hash_capacity ? index->hash_capacity * 2 : DEDUP_INITIAL_CAPACITY;
+        DedupHash *hashes = (DedupHash*)mem_calloc(MEM_ROWS, capacity, sizeof(DedupHash));
+        if (!hashes) {
+            fprintf(stderr, "Memory allocation failed for dedup index\n");
+            exit(1);
+        }
+        for (size_t i = 0; i < index->hash_capacity; i++) {
+            if (index->hashes[i].object) {
+                size_t slot = hash_pointer(index->hashes[i].object) & (capacity - 1);
+                while (hashes[slot].object) {
+                    slot = (slot + 1) & (capacity - 1);
+                }
+                hashes[slot] = index->hashes[i];
+            }
+        }
+        mem_free(MEM_ROWS, index->hashes);
+        index->hashes = hashes;
+        index->hash_capacity = capacity;
+    }
+    
+    size_t mask = index->hash_capacity - 1;
+    size_t slot = hash_pointer(object) & mask;
+    while (index->hashes[slot].object) {
+        slot = (slot + 1) & mask;
+    }
+    index->hashes[slot].object = object;
+    index->hashes[slot].hash = hash;
+    index->hash_count++;
+}
+
+uint64_t dedup_hash(DedupIndex *index, JsonValue *object) {
+    if (index->hash_count > 0) {
+        size_t mask = index->hash_capacity - 1;
+        size_t slot = hash_pointer(object) & mask;
+        while (index->hashes[slot].object) {
+            if (index->hashes[slot].object == object) {
+                return index->hashes[slot].hash;
+            }
+            slot = (slot + 1) & mask;
+        }
+    }
+    return hash_json_tree(object, remember_hash, index);
+}
+
+/* ID of an earlier object of table equal to object, or 0 if none */
+int64_t dedup_find(DedupIndex *index, Table *table, JsonValue *object, uint64_t hash) {
+    size_t mask = index->capacity - 1;
+    size_t slot = (size_t)hash & mask;
+    
+    while (index->entries[slot].id != 0) {
+        DedupEntry *entry = &index->entries[slot];
+        /* Equal hashes are confirmed so a collision never merges rows */
+        if (entry->hash == hash && entry->table == table && json_values_equal(entry->object, object)) {
+            return entry->id;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return 0;
+}
+
+/* Double the slot count and reinsert every entry */
+static void grow_dedup_index(DedupIndex *index) {
+    size_t capacity = index->capacity * 2;
+    DedupEntry *entries = (DedupEntry*)mem_calloc(MEM_ROWS, capacity, sizeof(DedupEntry));
+    if (!entries) {
+        fprintf(stderr, "Memory allocation failed for dedup index\n");
+        exit(1);
+    }
+    
+    for (size_t i = 0; i < index->capacity; i++) {
+        if (index->entries[i].id == 0) {
+            continue;
+        }
+        size_t slot = (size_t)index->entries[i].hash & (capacity - 1);
+        while (entries[slot].id != 0) {
+            slot = (slot + 1) & (capacity - 1);
+        }
+        entries[slot] = index->entries[i];
+    }
+    
+    mem_free(MEM_ROWS, index->entries);
+    index->entries = entries;
+    index->capacity = capacity;
+}
+
+/* Remember that object was emitted as row id of table */
+void dedup_insert(DedupIndex *index, Table *table, JsonValue *object, uint64_t hash, int64_t id) {
+    /* Keep the load factor under 3/4 so probe runs stay short */
+    if ((index->count + 1) * 4 > index->capacity * 3) {
+        grow_dedup_index(index);
+    }
+    
+    size_t mask = index->capacity - 1;
+    size_t slot = (size_t)hash & mask;
+    while (index->entries[slot].id != 0) {
+        slot = (slot + 1) & mask;
+    }
+    
+    DedupEntry *entry = &index->entries[slot];
+    entry->hash = hash;
+    entry->table = table;
+    entry->object = object;
+    entry->id = id;
+    index->count++;
+}
+
+void free_dedup_index(DedupIndex *index) {
+    if (!index) {
+        return;
+    }
+    mem_free(MEM_ROWS, index->entries);
+    mem_free(MEM_ROWS, index->hashes);
+    mem_free(MEM_ROWS, index);
+}
@@ -0,0 +1,48 @@
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ast.h"
+#include "schema.h"
+
+/* One distinct nested object already emitted as a row */
+typedef struct DedupEntry {
+    uint64_t hash;
+    Table *table;
+    JsonValue *object;  /* Owned by the AST */
+    int64_t id;         /* 0 marks a free slot */
+} DedupEntry;
+
+/* Hash of a nested object, worked out while hashing an enclosing one */
+typedef struct DedupHash {
+    JsonValue *object;  /* NULL marks a free slot */
+    uint64_t hash;
+} DedupHash;
+
+/* Open-addressing index from object contents to row ID */
+typedef struct DedupIndex {
+    DedupEntry *entries;
+    size_t capacity;  /* Always a power of two */
+    size_t count;
+    DedupHash *hashes;      /* Hashes recorded while hashing enclosing objects */
+    size_t hash_capacity;   /* Always a power of two, or 0 */
+    size_t hash_count;
+} DedupIndex;
+
+DedupIndex* create_dedup_index(void);
+
+/* Hash of a nested object's contents. Extraction reaches objects
+ * top-down, so hashing an object also records the hashes of the objects
+ * nested in it; each node is hashed once however deep it lies. */
+uint64_t dedup_hash(DedupIndex *index, JsonValue *object);
+
+/* ID of an earlier object of table equal to object, or 0 if none */
+int64_t dedup_find(DedupIndex *index, Table *table, JsonValue *object, uint64_t hash);
+
+/* Remember that object was emitted as row id of table */
+void dedup_insert(DedupIndex *index, Table *table, JsonValue *object, uint64_t hash, int64_t id);
+
+void free_dedup_index(DedupIndex *index);
+
+#endif /* DEDUP_H */
@@ -0,0 +1,163 @@
+#include "file_pool.h"
+#include "mem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Initial capacity of a file buffer */
+#define CSV_BUFFER_INITIAL (64 * 1024)
+
+/* Writes kept in flight by the asynchronous writer */
+#define FILE_POOL_QUEUE_DEPTH 64
+
+/* Make room for at least extra more bytes */
+void csv_buffer_reserve(CsvBuffer *buffer, size_t extra) {
+    if (buffer->length + extra <= buffer->capacity) {
+        return;
+    }
+    size_t capacity = buffer->capacity ? buffer->capacity : CSV_BUFFER_INITIAL;
+    while (capacity < buffer->length + extra) {
+        capacity *= 2;
+    }
+    char *data = (char*)mem_realloc(MEM_OUTPUT, buffer->data, capacity);
+    if (!data) {
+        fprintf(stderr, "Memory allocation failed for CSV buffer\n");
+        exit(1);
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+}
+
+void csv_buffer_append(CsvBuffer *buffer, const char *text, size_t length) {
+    csv_buffer_reserve(buffer, length);
+    memcpy(buffer->data + buffer->length, text, length);
+    buffer->length += length;
+}
+
+FilePool* create_file_pool(Codec codec) {
+    FilePool *pool = (FilePool*)mem_calloc(MEM_OUTPUT, 1, sizeof(FilePool));
+    if (!pool) {
+        fprintf(stderr, "Memory allocation failed for file pool\n");
+        exit(1);
+    }
+    pool->codec = codec;
+
+    /* Plain files are written through io_uring or a pwritev thread */
+    if (codec == CODEC_NONE) {
+        pool->writer = async_writer_create(FILE_POOL_QUEUE_DEPTH);
+    }
+    return pool;
+}
+
+/* Register an output file; nothing is opened until data is flushed */
+PooledFile* file_pool_add(FilePool *pool, const char *path, int append) {
+    PooledFile *file = (PooledFile*)mem_calloc(MEM_OUTPUT, 1, sizeof(PooledFile));
+    if (!file) {
+        fprintf(stderr, "Memory allocation failed for pooled file\n");
+        exit(1);
+    }
+    file->path = mem_strdup(MEM_OUTPUT, path);
+    if (!file->path) {
+        fprintf(stderr, "Memory allocation failed for pooled file\n");
+        exit(1);
+    }
+    file->append = append;
+
+    file->next = pool->files;
+    pool->files = file;
+    return file;
+}
+
+/* Close a file's descriptor; queued plain-file writes still complete */
+static void close_pooled(FilePool *pool, PooledFile *file) {
+    if (file->async) {
+        async_file_close(pool->writer, file->async);
+        file->async = NULL;
+    } else if (file->stream) {
+        long size = close_output_stream(file->stream);
+        file->stream = NULL;
+        if (size < 0) {
+            exit(1);
+        }
+        file->bytes += size;
+    }
+}
+
+/* Open a file on its first flush */
+static void open_pooled(FilePool *pool, PooledFile *file) {
+    if (file->async || file->stream) {
+        return;
+    }
+    if (pool->writer) {
+        file->async = async_file_open(pool->writer, file->path, file->append);
+        if (!file->async) {
+            exit(1);
+        }
+    } else {
+        file->stream = open_output_stream(file->path, pool->codec, file->append);
+        if (!file->stream) {
+            exit(1);
+        }
+    }
+    file->opened = 1;
+}
+
+/* Write a file's buffered text, opening it if needed */
+void file_pool_flush(FilePool *pool, PooledFile *file) {
+    CsvBuffer *buffer = &file->buffer;
+
+    /* An empty file is still created so every table has its CSV */
+    if (buffer->length == 0 && file->opened) {
+        return;
+    }
+    open_pooled(pool, file);
+    if (buffer->length == 0) {
+        return;
+    }
+
+    if (file->async) {
+        /* The writer takes the buffer; start a fresh one */
+        async_file_write(pool->writer, file->async, buffer->data, buffer->length);
+        file->bytes += buffer->length;
+        buffer->data = NULL;
+        buffer->capacity = 0;
+    } else if (fwrite(buffer->data, 1, buffer->length, file->stream->file) != buffer->length) {
+        fprintf(stderr, "Error writing file %s\n", file->path);
+        exit(1);
+    }
+    buffer->length = 0;
+}
+
+/* Flush and close a file for good */
+void file_pool_finish(FilePool *pool, PooledFile *file) {
+    file_pool_flush(pool, file);
+    close_pooled(pool, file);
+    mem_free(MEM_OUTPUT, file->buffer.data);
+    file->buffer.data = NULL;
+    file->buffer.capacity = 0;
+}
+
+/* Finish every file and free the pool */
+int free_file_pool(FilePool *pool) {
+    PooledFile *file = pool->files;
+    while (file) {
+        file_pool_finish(pool, file);
+        file = file->next;
+    }
+
+    /* Wait for queued plain-file writes to reach the disk */
+    int status = 0;
+    if (pool->writer) {
+        status = async_writer_destroy(pool->writer);
+    }
+
+    file = pool->files;
+    while (file) {
+        PooledFile *next = file->next;
+        mem_free(MEM_OUTPUT, file->path);
+        mem_free(MEM_OUTPUT, file);
+        file = next;
+    }
+    mem_free(MEM_OUTPUT, pool);
+    return status;
+}
@@ -0,0 +1,55 @@
+#ifndef FILE_POOL_H
+#define FILE_POOL_H
+
+#include <stddef.h>
+#include "stream_io.h"
+#include "async_io.h"
+
+/* Growable buffer of formatted CSV text */
+typedef struct CsvBuffer {
+    char *data;
+    size_t length;
+    size_t capacity;
+} CsvBuffer;
+
+/* One output file of the pool. Text is collected in its buffer, and the
+ * file is opened by the first flush. */
+typedef struct PooledFile {
+    char *path;
+    CsvBuffer buffer;            /* Text not yet handed to the file */
+    AsyncFile *async;            /* Open plain file, or NULL */
+    OutputStream *stream;        /* Open compressed file, or NULL */
+    int opened;                  /* Opened by an earlier flush */
+    int append;                  /* Keep existing contents */
+    long bytes;                  /* Bytes stored so far */
+    struct PooledFile *next;     /* All files of the pool */
+} PooledFile;
+
+/* Output files of one conversion. Tables are written one after another
+ * and each file is finished before the next is opened, so descriptors
+ * stay bounded however many tables there are. */
+typedef struct FilePool {
+    Codec codec;
+    AsyncWriter *writer;         /* Writes plain files asynchronously */
+    PooledFile *files;
+} FilePool;
+
+FilePool* create_file_pool(Codec codec);
+
+/* Register an output file; nothing is opened until data is flushed */
+PooledFile* file_pool_add(FilePool *pool, const char *path, int append);
+
+/* Write a file's buffered text, opening the file if needed */
+void file_pool_flush(FilePool *pool, PooledFile *file);
+
+/* Flush and close a file for good; its byte count stays valid */
+void file_pool_finish(FilePool *pool, PooledFile *file);
+
+/* Finish every file and free the pool. Returns nonzero on write errors. */
+int free_file_pool(FilePool *pool);
+
+/* Buffer helpers */
+void csv_buffer_reserve(CsvBuffer *buffer, size_t extra);
+void csv_buffer_append(CsvBuffer *buffer, const char *text, size_t length);
+
+#endif /* FILE_POOL_H */
@@ -0,0 +1,518 @@
+#include "json_parser.h"
+#include "json_string.h"
+#include "mem.h"
+
+/*
+ * Direct-to-AST JSON parser.
+ *
+ * Nodes are created exactly once and linked in place through list tails
+ * kept on an explicit stack of open containers, so nesting depth is only
+ * bounded by memory and no temporary pair/element lists are built.
+ * The accepted token syntax matches scanner.l.
+ *
+ * With a --select projection, members outside the selected paths are
+ * skipped by matching quotes and brackets only: no nodes, strings or
+ * numbers are built for them.
+ */
+
+/* One open object or array */
+typedef struct ParseFrame {
+    JsonValue *container;
+    KeyValuePair *pair_tail;      /* Last pair of an object */
+    ArrayElement *element_tail;   /* Last element of an array */
+    char *pending_key;            /* Key waiting for its value, on the heap or in key_buffer */
+    const SelectNode *select;     /* Paths selected below this container, NULL for all */
+    const SelectNode *pending_select;  /* Selection for the pending key's value */
+    int pending_skip;             /* The pending key is not selected */
+} ParseFrame;
+
+/* Parser state */
+typedef struct Parser {
+    const char *p;           /* Current position */
+    const char *end;
+    const char *line_start;  /* For column numbers */
+    int line;
+    ParseFrame *stack;
+    int depth;
+    int capacity;
+    const SelectNode *select;  /* Projection of the document, or NULL */
+    char key_buffer[sizeof(((KeyValuePair*)0)->short_key)];  /* A short pending key */
+} Parser;
+
+/* Report a syntax error at the current position */
+static void parse_error(Parser *parser, const char *msg) {
+    fprintf(stderr, "Error: %s at line %d, column %d\n", msg, parser->line,
+            (int)(parser->p - parser->line_start) + 1);
+}
+
+/* Skip whitespace, keeping line numbers current */
+static void skip_whitespace(Parser *parser) {
+    while (parser->p < parser->end) {
+        char c = *parser->p;
+        if (c == ' ' || c == '\t') {
+            parser->p++;
+        } else if (c == '\n' || c == '\r') {
+            /* \r\n counts as a single line break */
+            if (c == '\r' && parser->p + 1 < parser->end && parser->p[1] == '\n') {
+                parser->p++;
+            }
+            parser->p++;
+            parser->line++;
+            parser->line_start = parser->p;
+        } else {
+            break;
+        }
+    }
+}
+
+/* Current column (1-based) */
+static int current_column(Parser *parser) {
+    return (int)(parser->p - parser->line_start) + 1;
+}
+
+/* Parse a string token into buf when its decoded contents fit in size
+ * bytes; returns buf, or a newly allocated copy for longer text */
+static char* parse_string(Parser *parser, char *buf, size_t size) {
+    const char *start = ++parser->p;  /* Skip opening quote */
+    const char *close;
+    const char *error;
+    char *str = json_decode_string_into(start, parser->end, buf, size, &close, &error);
+
+    /* Strings may span lines */
+    for (const char *c = start; c < close; c++) {
+        if (*c == '\n') {
+            parser->line++;
+            parser->line_start = c + 1;
+        }
+    }
+
+    if (!str) {
+        parser->p = close;
+        parse_error(parser, error);
+        return NULL;
+    }
+
+    parser->p = close + 1;
+    return str;
+}
+
+/* Bytes that end a number or literal being skipped */
+static const unsigned char skip_delimiter[256] = {
+    ['\0'] = 1, [' '] = 1, ['\t'] = 1, ['\r'] = 1, ['\n'] = 1, ['"'] = 1,
+    [','] = 1, [':'] = 1, ['{'] = 1, ['}'] = 1, ['['] = 1, [']'] = 1
+};
+
+/* Skip one value without building it: strings are matched up to their
+ * closing quote and containers up to their closing bracket. Contents of
+ * skipped values are not validated beyond that. */
+static int skip_value(Parser *parser) {
+    int depth = 0;
+    do {
+        skip_whitespace(parser);
+        if (parser->p >= parser->end) {
+            parse_error(parser, "Unexpected end of input");
+            return 0;
+        }
+
+        char c = *parser->p;
+        if (c == '"') {
+            const char *q = parser->p + 1;
+            for (;;) {
+                q = json_scan_string_special(q, parser->end);
+                if (q == parser->end || (*q == '\\' && q + 1 == parser->end)) {
+                    parse_error(parser, "Unterminated string");
+                    return 0;
+                }
+                if (*q == '"') {
+                    break;
+                }
+                q += 2;  /* Step over the escaped character */
+            }
+
+            /* Strings may span lines */
+            const char *nl = parser->p;
+            while ((nl = memchr(nl, '\n', q - nl)) != NULL) {
+                parser->line++;
+                parser->line_start = ++nl;
+            }
+            parser->p = q + 1;
+        } else if (c == '{' || c == '[') {
+            depth++;
+            parser->p++;
+        } else if (c == '}' || c == ']') {
+            if (depth == 0) {
+                parse_error(parser, "Unexpected character");
+                return 0;
+            }
+            depth--;
+            parser->p++;
+        } else if (depth > 0 && (c == ',' || c == ':')) {
+            parser->p++;
+        } else {
+            /* Number or literal: runs up to the next delimiter */
+            const char *q = parser->p;
+            while (q < parser->end && !skip_delimiter[(unsigned char)*q]) {
+                q++;
+            }
+            if (q == parser->p) {
+                parse_error(parser, "Unexpected character");
+                return 0;
+            }
+            parser->p = q;
+        }
+    } while (depth > 0);
+    return 1;
+}
+
+/* Parse a number token: -?[0-9]+(\.[0-9]+)?([eE][+-]?[0-9]+)? */
+static int parse_number(Parser *parser, double *value) {
+    const char *start = parser->p;
+    const char *q = start;
+
+    if (*q == '-') {
+        q++;
+    }
+    if (q >= parser->end || *q < '0' || *q > '9') {
+        parse_error(parser, "Invalid number");
+        return 0;
+    }
+    while (q < parser->end && *q >= '0' && *q <= '9') {
+        q++;
+    }
+    if (q + 1 < parser->end && *q == '.' && q[1] >= '0' && q[1] <= '9') {
+        q++;
+        while (q < parser->end && *q >= '0' && *q <= '9') {
+            q++;
+        }
+    }
+    if (q < parser->end && (*q == 'e' || *q == 'E')) {
+        const char *exp = q + 1;
+        if (exp < parser->end && (*exp == '+' || *exp == '-')) {
+            exp++;
+        }
+        if (exp < parser->end && *exp >= '0' && *exp <= '9') {
+            q = exp;
+            while (q < parser->end && *q >= '0' && *q <= '9') {
+                q++;
+            }
+        }
+    }
+
+    *value = strtod(start, NULL);
+    parser->p = q;
+    return 1;
+}
+
+/* Match a literal keyword */
+static int match_literal(Parser *parser, const char *word, size_t len) {
+    if ((size_t)(parser->end - parser->p) >= len && memcmp(parser->p, word, len) == 0) {
+        parser->p += len;
+        return 1;
+    }
+    return 0;
+}
+
+/* Open a new container frame */
+static void push_frame(Parser *parser, JsonValue *container, const SelectNode *select) {
+    if (parser->depth == parser->capacity) {
+        parser->capacity = parser->capacity ? parser->capacity * 2 : 64;
+        parser->stack = (ParseFrame*)mem_realloc(MEM_INPUT, parser->stack, parser->capacity * sizeof(ParseFrame));
+        if (!parser->stack) {
+            fprintf(stderr, "Memory allocation failed for parser stack\n");
+            exit(1);
+        }
+    }
+
+    ParseFrame *frame = &parser->stack[parser->depth++];
+    frame->container = container;
+    frame->pair_tail = NULL;
+    frame->element_tail = NULL;
+    frame->pending_key = NULL;
+    frame->select = select;
+    frame->pending_select = NULL;
+    frame->pending_skip = 0;
+}
+
+/* Node the next value is built in: a new member of the open container,
+ * linked after its tail right away, or the document root */
+static JsonValue* value_slot(Parser *parser) {
+    if (parser->depth == 0) {
+        return new_json_value();
+    }
+
+    ParseFrame *top = &parser->stack[parser->depth - 1];
+    if (top->container->type == JSON_OBJECT) {
+        KeyValuePair *pair = top->pending_key == parser->key_buffer
+                             ? new_key_value_copy(top->pending_key)
+                             : new_key_value(top->pending_key);
+        top->pending_key = NULL;
+        if (top->pair_tail) {
+            top->pair_tail->next = pair;
+        } else {
+            top->container->value.object_head = pair;
+        }
+        top->pair_tail = pair;
+        return &pair->value;
+    }
+
+    ArrayElement *elem = new_array_element();
+    if (top->element_tail) {
+        top->element_tail->next = elem;
+    } else {
+        top->container->value.array_head = elem;
+    }
+    top->element_tail = elem;
+    return &elem->value;
+}
+
+/* Drop a frame's pending key without making a pair of it */
+static void free_pending_key(Parser *parser, ParseFrame *frame) {
+    if (frame->pending_key != parser->key_buffer) {
+        mem_free(MEM_STRINGS, frame->pending_key);
+    }
+    frame->pending_key = NULL;
+}
+
+/* Parse `"key" :` inside an object into the top frame */
+static int parse_key(Parser *parser) {
+    skip_whitespace(parser);
+    if (parser->p >= parser->end || *parser->p != '"') {
+        parse_error(parser, "Expected string key");
+        return 0;
+    }
+
+    char *key = parse_string(parser, parser->key_buffer, sizeof(parser->key_buffer));
+    if (!key) {
+        return 0;
+    }
+    ParseFrame *top = &parser->stack[parser->depth - 1];
+    top->pending_key = key;
+    
+    /* Look the member up in the projection; a terminal node keeps it all */
+    top->pending_select = NULL;
+    top->pending_skip = 0;
+    if (top->select) {
+        const SelectNode *member = select_member(top->select, key);
+        if (!member) {
+            top->pending_skip = 1;
+        } else if (!member->terminal) {
+            top->pending_select = member;
+        }
+    }
+
+    skip_whitespace(parser);
+    if (parser->p >= parser->end || *parser->p != ':') {
+        parse_error(parser, "Expected ':'");
+        return 0;
+    }
+    parser->p++;
+    return 1;
+}
+
+/* Release everything built so far after an error.
+ * Values are linked into their parent as soon as they are created, so the
+ * outermost open container owns all of them. */
+static void discard_partial(Parser *parser) {
+    for (int i = 0; i < parser->depth; i++) {
+        free_pending_key(parser, &parser->stack[i]);
+    }
+    if (parser->depth > 0) {
+        free_json_value(parser->stack[0].container);
+    }
+}
+
+/* Parse a NUL-terminated buffer of the given length, keeping only the
+ * members selected by select (NULL keeps everything) */
+JsonValue* parse_json_buffer(const char *text, size_t length, const SelectNode *select) {
+    Parser parser = {text, text + length, text, 1, NULL, 0, 0, select, ""};
+    JsonValue *value = NULL;
+    JsonValue *root = NULL;
+
+    for (;;) {
+        /* Expect a value */
+        value = NULL;
+        skip_whitespace(&parser);
+        if (parser.p >= parser.end) {
+            parse_error(&parser, "Unexpected end of input");
+            goto fail;
+        }
+
+        int line = parser.line;
+        int column = current_column(&parser);
+        char c = *parser.p;
+
+        /* Decide whether the projection keeps this value. Below a partly
+         * selected member only containers can hold the selected paths. */
+        const SelectNode *select = parser.select;
+        int keep = 1;
+        if (parser.depth > 0) {
+            ParseFrame *top = &parser.stack[parser.depth - 1];
+            if (top->container->type == JSON_OBJECT) {
+                select = top->pending_select;
+                keep = !top->pending_skip;
+            } else {
+                select = top->select;
+            }
+            if (select && c != '{' && c != '[') {
+                keep = 0;
+            }
+        }
+
+        if (!keep) {
+            if (!skip_value(&parser)) {
+                goto fail;
+            }
+            free_pending_key(&parser, &parser.stack[parser.depth - 1]);
+        } else if (c == '{' || c == '[') {
+            parser.p++;
+
+            /* Link the container into its parent before descending */
+            JsonValue *container = value_slot(&parser);
+            if (c == '{') {
+                init_object(container);
+            } else {
+                init_array(container);
+            }
+            set_json_position(container, line, column);
+            push_frame(&parser, container, select);
+
+            skip_whitespace(&parser);
+            if (parser.p < parser.end && *parser.p == (c == '{' ? '}' : ']')) {
+                /* Empty container */
+                parser.p++;
+                value = container;
+                parser.depth--;
+            } else {
+                if (c == '{' && !parse_key(&parser)) {
+                    goto fail;
+                }
+                continue;
+            }
+        } else {
+            /* Scalar value, read before its member is linked so a
+             * malformed one leaves nothing half built */
+            char short_string[JSON_INLINE_MAX + 1];  /* Fits inline in the node */
+            char *str = NULL;
+            double number = 0;
+            int boolean = 0;
+            JsonType type;
+            if (c == '"') {
+                str = parse_string(&parser, short_string, sizeof(short_string));
+                if (!str) {
+                    goto fail;
+                }
+                type = JSON_STRING;
+            } else if (c == '-' || (c >= '0' && c <= '9')) {
+                if (!parse_number(&parser, &number)) {
+                    goto fail;
+                }
+                type = JSON_NUMBER;
+            } else if (match_literal(&parser, "true", 4)) {
+                type = JSON_BOOLEAN;
+                boolean = 1;
+            } else if (match_literal(&parser, "false", 5)) {
+                type = JSON_BOOLEAN;
+            } else if (match_literal(&parser, "null", 4)) {
+                type = JSON_NULL;
+            } else {
+                parse_error(&parser, "Unexpected character");
+                goto fail;
+            }
+
+            /* Build it in place in the enclosing container */
+            value = value_slot(&parser);
+            switch (type) {
+                case JSON_STRING:
+                    if (str == short_string) {
+                        init_string(value, short_string);
+                    } else {
+                        init_string_owned(value, str);
+                    }
+                    break;
+                case JSON_NUMBER:
+                    init_number(value, number);
+                    break;
+                case JSON_BOOLEAN:
+                    init_boolean(value, boolean);
+                    break;
+                default:
+                    init_null(value);
+                    break;
+            }
+            set_json_position(value, line, column);
+        }
+
+        /* A value is complete: close containers or move to the next member */
+        for (;;) {
+            if (parser.depth == 0) {
+                root = value;
+                goto done;
+            }
+
+            ParseFrame *top = &parser.stack[parser.depth - 1];
+            char close = top->container->type == JSON_OBJECT ? '}' : ']';
+
+            skip_whitespace(&parser);
+            if (parser.p < parser.end && *parser.p == ',') {
+                parser.p++;
+                if (close == '}' && !parse_key(&parser)) {
+                    goto fail;
+                }
+                break;  /* Next member value */
+            }
+            if (parser.p < parser.end && *parser.p == close) {
+                parser.p++;
+                value = top->container;
+                parser.depth--;
+                continue;
+            }
+
+            parse_error(&parser, close == '}' ? "Expected ',' or '}'" : "Expected ',' or ']'");
+            goto fail;
+        }
+    }
+
+done:
+    skip_whitespace(&parser);
+    if (parser.p < parser.end) {
+        parse_error(&parser, "Trailing characters after JSON value");
+        free_json_value(root);
+        root = NULL;
+    }
+    mem_free(MEM_INPUT, parser.stack);
+    return root;
+
+fail:
+    discard_partial(&parser);
+    mem_free(MEM_INPUT, parser.stack);
+    return NULL;
+}
+
+/* Read a whole stream and parse it */
+JsonValue* parse_json_stream(FILE *input, const SelectNode *select) {
+    size_t capacity = 1 << 16;
+    size_t length = 0;
+    char *buffer = (char*)mem_alloc(MEM_INPUT, capacity);
+    if (!buffer) {
+        fprintf(stderr, "Memory allocation failed for input buffer\n");
+        exit(1);
+    }
+
+    size_t n;
+    while ((n = fread(buffer + length, 1, capacity - length - 1, input)) > 0) {
+        length += n;
+        if (capacity - length - 1 == 0) {
+            capacity *= 2;
+            buffer = (char*)mem_realloc(MEM_INPUT, buffer, capacity);
+            if (!buffer) {
+                fprintf(stderr, "Memory allocation failed for input buffer\n");
+                exit(1);
+            }
+        }
+    }
+    buffer[length] = '\0';
+
+    JsonValue *root = parse_json_buffer(buffer, length, select);
+    mem_free(MEM_INPUT, buffer);
+    return root;
+}
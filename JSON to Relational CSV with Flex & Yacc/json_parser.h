@@ -0,0 +1,21 @@
+#ifndef JSON_PARSER_H
+#define JSON_PARSER_H
+
+#include "ast.h"
+#include "select.h"
+
+/* Parser backends selectable from the command line */
+typedef enum {
+    PARSER_BISON,      /* Flex scanner + Bison LALR grammar */
+    PARSER_ITERATIVE   /* Hand-written parser with an explicit stack */
+} ParserKind;
+
+/* Parse a whole JSON document from a stream with the hand-written parser.
+ * Members outside select are skipped without building nodes; pass NULL
+ * to keep everything. Returns NULL after reporting an error on stderr. */
+JsonValue* parse_json_stream(FILE *input, const SelectNode *select);
+
+/* Parse a NUL-terminated buffer of the given length */
+JsonValue* parse_json_buffer(const char *text, size_t length, const SelectNode *select);
+
+#endif /* JSON_PARSER_H */
@@ -0,0 +1,399 @@
+#include "json_string.h"
+#include "mem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/*
+ * String literals are decoded in runs: a vector scan finds the next quote
+ * or backslash 16 bytes at a time, the bytes before it are copied with one
+ * memcpy, and only the escape itself goes through the scalar decoder.
+ * Strings without escapes take a single scan and a single copy.
+ */
+
+Utf8Mode json_utf8_mode = UTF8_ACCEPT;
+unsigned long json_utf8_replacements = 0;
+
+/* First '"' or '\\' in [p, end), or end if there is none */
+const char* json_scan_string_special(const char *p, const char *end) {
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)p);
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                                                  _mm_cmpeq_epi8(chunk, backslash)));
+        if (mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+#elif defined(__ARM_NEON)
+    const uint8x16_t quote = vdupq_n_u8('"');
+    const uint8x16_t backslash = vdupq_n_u8('\\');
+    while (end - p >= 16) {
+        uint8x16_t chunk = vld1q_u8((const uint8_t*)p);
+        uint8x16_t hits = vorrq_u8(vceqq_u8(chunk, quote), vceqq_u8(chunk, backslash));
+        if (vmaxvq_u8(hits)) {
+            break;  /* The scalar loop below finds the exact byte */
+        }
+        p += 16;
+    }
+#endif
+    while (p < end && *p != '"' && *p != '\\') {
+        p++;
+    }
+    return p;
+}
+
+/* Value of four hex digits, or -1 */
+static long parse_hex4(const char *p, const char *end) {
+    if (end - p < 4) {
+        return -1;
+    }
+    long value = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        value <<= 4;
+        if (c >= '0' && c <= '9') {
+            value |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            value |= c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            value |= c - 'A' + 10;
+        } else {
+            return -1;
+        }
+    }
+    return value;
+}
+
+/* Write a code point as UTF-8; returns the number of bytes */
+static int encode_utf8(unsigned long code, char *out) {
+    if (code < 0x80) {
+        out[0] = (char)code;
+        return 1;
+    }
+    if (code < 0x800) {
+        out[0] = (char)(0xC0 | (code >> 6));
+        out[1] = (char)(0x80 | (code & 0x3F));
+        return 2;
+    }
+    if (code < 0x10000) {
+        out[0] = (char)(0xE0 | (code >> 12));
+        out[1] = (char)(0x80 | ((code >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (code & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (code >> 18));
+    out[1] = (char)(0x80 | ((code >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((code >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (code & 0x3F));
+    return 4;
+}
+
+/* Decode one escape at p (a backslash) into out. Returns the number of
+ * bytes written and advances *p past the escape, or returns -1 with *p
+ * left at the backslash. */
+static int decode_escape(const char **p, const char *end, char *out, const char **error) {
+    const char *q = *p + 1;
+    if (q >= end) {
+        *error = "Unterminated string";
+        return -1;
+    }
+
+    char simple;
+    switch (*q) {
+        case '"':  simple = '"';  break;
+        case '\\': simple = '\\'; break;
+        case '/':  simple = '/';  break;
+        case 'b':  simple = '\b'; break;
+        case 'f':  simple = '\f'; break;
+        case 'n':  simple = '\n'; break;
+        case 'r':  simple = '\r'; break;
+        case 't':  simple = '\t'; break;
+        case 'u':  simple = 0;    break;
+        default:
+            *error = "Invalid escape sequence in string";
+            return -1;
+    }
+    if (simple) {
+        *out = simple;
+        *p = q + 1;
+        return 1;
+    }
+
+    long code = parse_hex4(q + 1, end);
+    if (code < 0) {
+        *error = "Invalid \\u escape in string";
+        return -1;
+    }
+    q += 5;
+
+    if (code >= 0xD800 && code <= 0xDBFF) {
+        /* A high surrogate combines with the low surrogate after it */
+        long low = -1;
+        if (end - q >= 2 && q[0] == '\\' && q[1] == 'u') {
+            low = parse_hex4(q + 2, end);
+        }
+        if (low < 0xDC00 || low > 0xDFFF) {
+            *error = "Unpaired surrogate in \\u escape";
+            return -1;
+        }
+        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+        q += 6;
+    } else if (code >= 0xDC00 && code <= 0xDFFF) {
+        *error = "Unpaired surrogate in \\u escape";
+        return -1;
+    } else if (code == 0) {
+        *error = "\\u0000 is not supported in strings";
+        return -1;
+    }
+
+    *p = q;
+    return encode_utf8((unsigned long)code, out);
+}
+
+/* Length of the well-formed sequence at p, or 0 if it is malformed, in
+ * which case *prefix is the length of its maximal invalid subpart: the
+ * lead byte plus any continuation bytes that were still acceptable */
+static size_t utf8_sequence(const unsigned char *p, size_t avail, size_t *prefix) {
+    unsigned char c = p[0];
+    size_t need;
+    unsigned char lo = 0x80, hi = 0xBF;  /* Range of the second byte */
+
+    if (c < 0x80) {
+        return 1;
+    } else if (c >= 0xC2 && c <= 0xDF) {
+        need = 2;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        need = 3;
+        if (c == 0xE0) {
+            lo = 0xA0;  /* No overlong forms */
+        } else if (c == 0xED) {
+            hi = 0x9F;  /* No surrogates */
+        }
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        need = 4;
+        if (c == 0xF0) {
+            lo = 0x90;
+        } else if (c == 0xF4) {
+            hi = 0x8F;  /* Nothing above U+10FFFF */
+        }
+    } else {
+        *prefix = 1;
+        return 0;
+    }
+
+    size_t i = 1;
+    while (i < need && i < avail) {
+        unsigned char min = i == 1 ? lo : 0x80;
+        unsigned char max = i == 1 ? hi : 0xBF;
+        if (p[i] < min || p[i] > max) {
+            break;
+        }
+        i++;
+    }
+    if (i == need) {
+        return need;
+    }
+    *prefix = i;
+    return 0;
+}
+
+/* Offset of the first byte of [p, p + len) that is not part of a
+ * well-formed UTF-8 sequence, or len if the block is valid */
+size_t utf8_find_invalid(const char *p, size_t len) {
+    const unsigned char *s = (const unsigned char*)p;
+    size_t i = 0;
+
+    while (i < len) {
+        /* Skip ASCII a vector at a time; real data is mostly ASCII */
+#if defined(__SSE2__)
+        while (len - i >= 16 && _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(s + i))) == 0) {
+            i += 16;
+        }
+#elif defined(__ARM_NEON)
+        while (len - i >= 16 && vmaxvq_u8(vld1q_u8(s + i)) < 0x80) {
+            i += 16;
+        }
+#endif
+        if (i >= len) {
+            break;
+        }
+        if (s[i] < 0x80) {
+            i++;
+            continue;
+        }
+
+        size_t prefix;
+        size_t n = utf8_sequence(s + i, len - i, &prefix);
+        if (n == 0) {
+            return i;
+        }
+        i += n;
+    }
+    return len;
+}
+
+/* Copy of str with each maximal invalid subpart replaced by U+FFFD */
+char* utf8_replace_invalid(const char *str, size_t len, unsigned long *replaced) {
+    /* Each replaced byte grows to at most the three bytes of U+FFFD */
+    char *out = (char*)mem_alloc(MEM_STRINGS, len * 3 + 1);
+    if (!out) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+
+    size_t in = 0;
+    size_t used = 0;
+    while (in < len) {
+        size_t bad = in + utf8_find_invalid(str + in, len - in);
+        memcpy(out + used, str + in, bad - in);
+        used += bad - in;
+        if (bad == len) {
+            break;
+        }
+
+        size_t prefix;
+        utf8_sequence((const unsigned char*)str + bad, len - bad, &prefix);
+        memcpy(out + used, "\xEF\xBF\xBD", 3);
+        used += 3;
+        in = bad + prefix;
+        (*replaced)++;
+    }
+    out[used] = '\0';
+    return out;
+}
+
+/* Apply json_utf8_mode to a decoded string whose source body is
+ * [start, close). Escapes always decode to whole code points, so the
+ * decoded text is well-formed exactly when the source bytes are. str is
+ * freed when it is replaced, unless it is the caller's buffer buf. */
+static char* check_utf8(char *str, size_t len, char *buf, const char *start, const char **close, const char **error) {
+    if (json_utf8_mode == UTF8_ACCEPT) {
+        return str;
+    }
+    size_t bad = utf8_find_invalid(start, *close - start);
+    if (bad == (size_t)(*close - start)) {
+        return str;
+    }
+
+    if (json_utf8_mode == UTF8_REJECT) {
+        if (str != buf) {
+            mem_free(MEM_STRINGS, str);
+        }
+        *close = start + bad;
+        *error = "Invalid UTF-8 in string";
+        return NULL;
+    }
+
+    /* Batch workers decode strings concurrently */
+    unsigned long replaced = 0;
+    char *fixed = utf8_replace_invalid(str, len, &replaced);
+    __atomic_fetch_add(&json_utf8_replacements, replaced, __ATOMIC_RELAXED);
+    if (str != buf) {
+        mem_free(MEM_STRINGS, str);
+    }
+    return fixed;
+}
+
+char* json_decode_string(const char *start, const char *end, const char **close, const char **error) {
+    return json_decode_string_into(start, end, NULL, 0, close, error);
+}
+
+char* json_decode_string_into(const char *start, const char *end, char *buf, size_t size,
+                              const char **close, const char **error) {
+    const char *special = json_scan_string_special(start, end);
+    if (special == end) {
+        *close = end;
+        *error = "Unterminated string";
+        return NULL;
+    }
+
+    /* Fast path: no escapes, copy the whole body at once */
+    if (*special == '"') {
+        size_t len = special - start;
+        char *str = buf;
+        if (len >= size) {
+            str = (char*)mem_alloc(MEM_STRINGS, len + 1);
+            if (!str) {
+                fprintf(stderr, "Memory allocation failed\n");
+                exit(1);
+            }
+        }
+        memcpy(str, start, len);
+        str[len] = '\0';
+        *close = special;
+        return check_utf8(str, len, buf, start, close, error);
+    }
+
+    /* Decode into buf while the text fits, then into a heap copy that
+     * grows as runs are copied; each copy also leaves room for one decoded
+     * escape (at most 4 bytes) and the terminator */
+    char *str = buf;
+    size_t capacity = size;
+    size_t len = 0;
+    const char *p = start;
+
+    for (;;) {
+        /* Copy the run before the next quote or backslash */
+        size_t run = special - p;
+        if (len + run + 5 > capacity) {
+            /* Decoded text is never longer than its source, so the source
+             * scanned so far plus the reserve always has room */
+            size_t needed = (size_t)(special - start) + 64;
+            capacity = capacity * 2 > needed ? capacity * 2 : needed;
+            char *grown;
+            if (str == buf) {
+                grown = (char*)mem_alloc(MEM_STRINGS, capacity);
+                if (grown && len > 0) {
+                    memcpy(grown, buf, len);
+                }
+            } else {
+                grown = (char*)mem_realloc(MEM_STRINGS, str, capacity);
+            }
+            if (!grown) {
+                fprintf(stderr, "Memory allocation failed\n");
+                exit(1);
+            }
+            str = grown;
+        }
+        memcpy(str + len, p, run);
+        len += run;
+        p = special;
+
+        if (p == end) {
+            if (str != buf) {
+                mem_free(MEM_STRINGS, str);
+            }
+            *close = end;
+            *error = "Unterminated string";
+            return NULL;
+        }
+        if (*p == '"') {
+            break;
+        }
+
+        int written = decode_escape(&p, end, str + len, error);
+        if (written < 0) {
+            if (str != buf) {
+                mem_free(MEM_STRINGS, str);
+            }
+            *close = p;
+            return NULL;
+        }
+        len += written;
+        special = json_scan_string_special(p, end);
+    }
+
+    str[len] = '\0';
+    *close = p;
+    return check_utf8(str, len, buf, start, close, error);
+}
@@ -0,0 +1,50 @@
+#ifndef JSON_STRING_H
+#define JSON_STRING_H
+
+#include <stddef.h>
+
+/* What to do with malformed UTF-8 inside string literals */
+typedef enum {
+    UTF8_ACCEPT,   /* Pass bytes through unchecked (default) */
+    UTF8_REJECT,   /* Fail with the line and column of the first bad byte */
+    UTF8_REPLACE   /* Substitute U+FFFD for each maximal invalid subpart */
+} Utf8Mode;
+
+/* Policy used by json_decode_string(), set from the command line */
+extern Utf8Mode json_utf8_mode;
+
+/* Invalid sequences replaced so far under UTF8_REPLACE */
+extern unsigned long json_utf8_replacements;
+
+/* Decode the contents of a JSON string literal into UTF-8.
+ *
+ * start points just past the opening quote and end bounds the input.
+ * On success returns a malloc'd, NUL-terminated string and sets *close to
+ * the closing quote. On error returns NULL, sets *close to the offending
+ * position (the bad escape, or end if the string is unterminated) and
+ * *error to a message.
+ *
+ * Escapes \" \\ \/ \b \f \n \r \t and \uXXXX are decoded; a \uXXXX high
+ * surrogate must be followed by a \uXXXX low surrogate and the pair is
+ * encoded as one 4-byte sequence. \u0000 is rejected since strings are
+ * stored NUL-terminated. Malformed UTF-8 is handled per json_utf8_mode;
+ * a rejected string reports the first bad byte through *close. */
+char* json_decode_string(const char *start, const char *end, const char **close, const char **error);
+
+/* As json_decode_string, but the text is decoded into buf when it fits
+ * in size bytes with its terminator, and buf is returned. Only longer
+ * text is allocated; the caller frees the result when it is not buf. */
+char* json_decode_string_into(const char *start, const char *end, char *buf, size_t size,
+                              const char **close, const char **error);
+
+/* First '"' or '\\' in [p, end), or end if there is none */
+const char* json_scan_string_special(const char *p, const char *end);
+
+/* Offset of the first byte of [p, p + len) that is not part of a
+ * well-formed UTF-8 sequence, or len if the block is valid */
+size_t utf8_find_invalid(const char *p, size_t len);
+
+/* Copy of str with each maximal invalid subpart replaced by U+FFFD */
+char* utf8_replace_invalid(const char *str, size_t len, unsigned long *replaced);
+
+#endif /* JSON_STRING_H */
@@ -1,92 +1,616 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #include "ast.h"
+#include "ast_dump.h"
 #include "schema.h"
 #include "csv_gen.h"
+#include "stats.h"
+#include "json_parser.h"
+#include "json_string.h"
+#include "stream_io.h"
+#include "batch.h"
+#include "sqlite_gen.h"
+#include "mem.h"
+
+/* Schema and ID high-water mark kept in the output directory by --append */
+#define APPEND_STATE_FILE ".json2relcsv-schema"
 
 /* External declarations */
 extern int yyparse();
 extern FILE *yyin;
 extern JsonValue *json_root;
 
+/* Command-line options */
+typedef struct Options {
+    int print_ast;
+    int positions;           /* Record source positions and print them with the AST */
+    AstDumpOptions dump;     /* --ast-format, --max-depth and --max-nodes */
+    int dump_set;            /* One of those was given */
+    int unify;               /* Merge overlapping object shapes per key */
+    int append;              /* Add rows to the files of an earlier run */
+    int dedup;               /* Emit identical nested objects once */
+    IdStrategy ids;          /* Row ID allocation */
+    int ids_set;             /* --ids was given */
+    int stats;               /* Report per-phase statistics on stderr */
+    ParserKind parser;       /* Parser backend */
+    Codec compress;          /* Compression for output files */
+    Utf8Mode utf8;           /* Handling of malformed UTF-8 in strings */
+    char *input_file;        /* Read this instead of stdin (.gz/.zst detected) */
+    char *stats_json_file;   /* Write statistics as JSON here ("-" for stdout) */
+    int mem_stats;           /* Report memory use per subsystem on stderr */
+    char *mem_trace_file;    /* Write the per-site allocation trace here */
+    char *out_dir;
+    char *sqlite_file;       /* Write tables to this SQLite database instead of CSV */
+    char *schema_file;       /* Load schema from here instead of inferring it */
+    char *save_schema_file;  /* Dump the inferred schema here */
+    char *batch;             /* Convert the files of this directory or list */
+    int jobs;                /* Batch and schema worker threads (0: one per CPU) */
+    int merge;               /* Write a batch into one set of tables */
+    SelectNode *select;      /* --select projection, or NULL for everything */
+    Predicate *where;        /* --where row filters */
+} Options;
+
 /* Command-line parsing */
-void parse_arguments(int argc, char *argv[], int *print_ast, char **out_dir);
+void parse_arguments(int argc, char *argv[], Options *options);
+static void write_stats_json(const char *path);
+static int convert_input(Options *options);
+static int convert_batch(Options *options);
+static int convert_documents(const Options *options, const char *out_dir, JsonValue **roots, int count);
 
 /* Main function */
 int main(int argc, char *argv[]) {
-    int print_ast = 0;
-    char *out_dir = NULL;
-    
+    Options options;
+
     /* Parse command-line arguments */
-    parse_arguments(argc, argv, &print_ast, &out_dir);
-    
+    parse_arguments(argc, argv, &options);
+    json_utf8_mode = options.utf8;
+
+    int status = options.batch ? convert_batch(&options) : convert_input(&options);
+    if (status != 0) {
+        return status;
+    }
+
+    /* Report statistics */
+    if (options.stats) {
+        print_stats(stderr);
+    }
+    if (options.stats_json_file) {
+        write_stats_json(options.stats_json_file);
+    }
+
+    /* Clean up */
+    free(options.out_dir);
+    free(options.sqlite_file);
+    free(options.schema_file);
+    free(options.save_schema_file);
+    free(options.stats_json_file);
+    free(options.input_file);
+    free(options.batch);
+    free_selection(options.select);
+    free_predicates(options.where);
+
+    /* Memory still held now was leaked */
+    if (options.mem_stats) {
+        print_mem_stats(stderr);
+    }
+    if (options.mem_trace_file && write_mem_trace(options.mem_trace_file) != 0) {
+        fprintf(stderr, "Error opening memory trace %s for writing\n", options.mem_trace_file);
+        exit(1);
+    }
+    free(options.mem_trace_file);
+
+    return 0;
+}
+
+/* Convert the single document read from --input or stdin */
+static int convert_input(Options *options) {
     /* Debug message */
-    fprintf(stderr, "DEBUG: Starting JSON parsing from stdin\n");
-    
-    /* Parse JSON from stdin */
-    yyin = stdin;
-    
+    fprintf(stderr, "DEBUG: Starting JSON parsing from %s\n", options->input_file ? options->input_file : "stdin");
+
+    /* Open the input; compressed data is decoded on a separate thread */
+    InputStream *input = open_input_stream(options->input_file);
+    if (!input) {
+        return 1;
+    }
+    yyin = input->file;
+
     /* Perform parsing */
     fprintf(stderr, "DEBUG: Starting parser\n");
-    if (yyparse() != 0) {
+    stats_phase_begin(PHASE_PARSE);
+    int parse_status;
+    if (options->parser == PARSER_ITERATIVE) {
+        json_root = parse_json_stream(yyin, options->select);
+        parse_status = json_root ? 0 : 1;
+    } else {
+        parse_status = yyparse();
+    }
+    if (close_input_stream(input) != 0) {
+        parse_status = 1;
+    }
+    stats_phase_end(PHASE_PARSE);
+    if (parse_status != 0) {
         /* Parser error - already reported */
         fprintf(stderr, "DEBUG: Parser returned with error\n");
         return 1;
     }
     fprintf(stderr, "DEBUG: Parsing completed successfully\n");
-    
+    if (json_utf8_replacements > 0) {
+        fprintf(stderr, "Warning: replaced %lu invalid UTF-8 sequence(s) with U+FFFD\n", json_utf8_replacements);
+    }
+
     if (!json_root) {
         fprintf(stderr, "Error: No JSON data parsed\n");
         return 1;
     }
-    
-    /* Create schema context */
-    SchemaContext *schema = create_schema_context(out_dir, print_ast);
-    
-    /* Detect schema from the JSON data */
-    detect_schema(schema, json_root);
-    
-    /* Generate CSV files */
-    generate_csv_files(schema, json_root);
-    
-    /* Clean up */
-    free_schema_context(schema);
+
+    int status = convert_documents(options, options->out_dir, &json_root, 1);
     free_json_value(json_root);
-    if (out_dir) {
-        free(out_dir);
+    return status;
+}
+
+/* Parse one batch input. Batch workers always use the iterative parser;
+ * the Bison parser keeps its state in globals. */
+static JsonValue* parse_batch_file(const char *path, const SelectNode *select) {
+    InputStream *input = open_input_stream(path);
+    if (!input) {
+        return NULL;
+    }
+    JsonValue *root = parse_json_stream(input->file, select);
+    if (close_input_stream(input) != 0 && root) {
+        free_json_value(root);
+        root = NULL;
+    }
+    if (!root) {
+        fprintf(stderr, "Error: failed to parse %s\n", path);
+    }
+    return root;
+}
+
+/* Shared state of the jobs of one batch */
+typedef struct BatchRun {
+    const Options *options;
+    BatchList *list;
+    const char *out_dir;     /* Parent of the per-file output directories */
+    JsonValue **roots;       /* Parsed documents, for --merge */
+} BatchRun;
+
+/* Parse one file of a merged batch into its slot */
+static int parse_batch_job(int index, void *arg) {
+    BatchRun *run = (BatchRun*)arg;
+    run->roots[index] = parse_batch_file(run->list->paths[index], run->options->select);
+    return run->roots[index] ? 0 : 1;
+}
+
+/* Convert one file of a batch into its own output directory */
+static int convert_batch_job(int index, void *arg) {
+    BatchRun *run = (BatchRun*)arg;
+
+    stats_phase_begin(PHASE_PARSE);
+    JsonValue *root = parse_batch_file(run->list->paths[index], run->options->select);
+    stats_phase_end(PHASE_PARSE);
+    if (!root) {
+        return 1;
+    }
+
+    char out_dir[4096];
+    snprintf(out_dir, sizeof(out_dir), "%s/%s", run->out_dir, run->list->names[index]);
+    int status = convert_documents(run->options, out_dir, &root, 1);
+    free_json_value(root);
+    return status;
+}
+
+/* Convert every file of --batch, one output directory per file or, with
+ * --merge, into one set of tables */
+static int convert_batch(Options *options) {
+    BatchList *list = load_batch_list(options->batch);
+    if (list->count == 0) {
+        fprintf(stderr, "Error: no input files found in %s\n", options->batch);
+        free_batch_list(list);
+        return 1;
     }
-    
+    int jobs = options->jobs > 0 ? options->jobs : default_job_count();
+    fprintf(stderr, "DEBUG: Converting %d file(s) with %d worker(s)\n", list->count, jobs < list->count ? jobs : list->count);
+
+    BatchRun run;
+    run.options = options;
+    run.list = list;
+    run.out_dir = options->out_dir ? options->out_dir : ".";
+    run.roots = NULL;
+
+    int status;
+    if (options->merge) {
+        /* Parse in parallel, then infer one schema and number the rows of
+         * every file in list order, so the output does not depend on
+         * which worker finished first */
+        run.roots = (JsonValue**)mem_calloc(MEM_AST, list->count, sizeof(JsonValue*));
+        if (!run.roots) {
+            fprintf(stderr, "Memory allocation failed for batch documents\n");
+            exit(1);
+        }
+        stats_phase_begin(PHASE_PARSE);
+        int failed = run_batch_jobs(list->count, jobs, parse_batch_job, &run);
+        stats_phase_end(PHASE_PARSE);
+
+        if (failed > 0) {
+            fprintf(stderr, "Error: %d of %d file(s) could not be parsed\n", failed, list->count);
+            status = 1;
+        } else {
+            status = convert_documents(options, options->out_dir, run.roots, list->count);
+        }
+        for (int i = 0; i < list->count; i++) {
+            free_json_value(run.roots[i]);
+        }
+        mem_free(MEM_AST, run.roots);
+    } else {
+        /* Each file gets its own contexts and output directory */
+        if (mkdir(run.out_dir, 0755) == -1 && errno != EEXIST) {
+            fprintf(stderr, "Error creating output directory %s: %s\n", run.out_dir, strerror(errno));
+            exit(1);
+        }
+
+        Options file_options = *options;
+        file_options.jobs = 1;  /* Files are the unit of parallelism */
+        run.options = &file_options;
+
+        int failed = run_batch_jobs(list->count, jobs, convert_batch_job, &run);
+        if (failed > 0) {
+            fprintf(stderr, "Error: %d of %d file(s) failed to convert\n", failed, list->count);
+        }
+        status = failed > 0 ? 1 : 0;
+    }
+
+    if (json_utf8_replacements > 0) {
+        fprintf(stderr, "Warning: replaced %lu invalid UTF-8 sequence(s) with U+FFFD\n", json_utf8_replacements);
+    }
+    free_batch_list(list);
+    return status;
+}
+
+/* Infer (or load) the schema of the parsed documents, extract their rows
+ * in order and write the CSV files to out_dir */
+static int convert_documents(const Options *options, const char *out_dir, JsonValue **roots, int count) {
+    IdStrategy ids = options->ids;
+
+    /* Create schema context */
+    SchemaContext *schema = create_schema_context(out_dir);
+    schema->unify = options->unify;
+    schema->jobs = options->jobs > 0 ? options->jobs : default_job_count();
+
+    /* Continue from the previous run's schema, if there was one */
+    char state_file[4096];
+    if (options->append) {
+        int length;
+        if (options->sqlite_file) {
+            /* A database keeps its state next to it */
+            length = snprintf(state_file, sizeof(state_file), "%s%s", options->sqlite_file, APPEND_STATE_FILE);
+        } else {
+            length = snprintf(state_file, sizeof(state_file), "%s/%s", schema->output_dir, APPEND_STATE_FILE);
+        }
+        /* A truncated name would load or overwrite some other file */
+        if (length < 0 || (size_t)length >= sizeof(state_file)) {
+            fprintf(stderr, "Error: --append state file path is too long\n");
+            free_schema_context(schema);
+            return 1;
+        }
+        if (access(state_file, F_OK) == 0) {
+            fprintf(stderr, "DEBUG: Appending to the run recorded in %s\n", state_file);
+            load_schema(schema, state_file);
+            mark_schema_stored(schema);
+
+            /* Mixing strategies would reuse IDs of earlier runs */
+            if (schema->id_strategy_loaded) {
+                if (options->ids_set && ids != schema->id_strategy) {
+                    fprintf(stderr, "Error: %s was written with --ids %s\n", state_file,
+                            schema->id_strategy == ID_PER_TABLE ? "per-table" : "dense");
+                    free_schema_context(schema);
+                    return 1;
+                }
+                ids = schema->id_strategy;
+            }
+        }
+    }
+    schema->id_strategy = ids;
+
+    if (options->print_ast) {
+        for (int i = 0; i < count; i++) {
+            dump_ast(stdout, roots[i], &options->dump);
+        }
+    }
+
+    stats_phase_begin(PHASE_SCHEMA);
+    if (options->schema_file) {
+        /* Reuse a persisted schema and skip the inference pass */
+        fprintf(stderr, "DEBUG: Loading schema from %s\n", options->schema_file);
+        load_schema(schema, options->schema_file);
+    } else {
+        /* Detect schema from the JSON data */
+        for (int i = 0; i < count; i++) {
+            detect_schema(schema, roots[i]);
+        }
+    }
+    stats_phase_end(PHASE_SCHEMA);
+
+    if (options->save_schema_file) {
+        save_schema(schema, options->save_schema_file);
+    }
+
+    /* Generate CSV files, timing extraction and output separately */
+    CsvContext *csv = create_csv_context(schema);
+    csv->codec = options->compress;
+    csv->id_strategy = ids;
+    if (options->dedup) {
+        csv->dedup = create_dedup_index();
+    }
+    csv->where = options->where;
+    if (schema->next_id > 0) {
+        csv->next_id = schema->next_id;  /* Keep keys unique across runs */
+    }
+
+    stats_phase_begin(PHASE_EXTRACT);
+    for (int i = 0; i < count; i++) {
+        extract_data(csv, roots[i]);
+    }
+    stats_phase_end(PHASE_EXTRACT);
+
+    stats_phase_begin(PHASE_WRITE);
+    if (options->sqlite_file) {
+        write_sqlite_database(csv, options->sqlite_file);
+    } else {
+        write_csv_files(csv);
+    }
+    stats_phase_end(PHASE_WRITE);
+
+    /* Record the schema and the next free ID for the following run */
+    if (options->append) {
+        if (ids == ID_PER_TABLE) {
+            TableData *table_data = csv->tables;
+            while (table_data) {
+                table_data->schema->next_id = table_data->next_id;
+                table_data = table_data->next;
+            }
+        } else {
+            schema->next_id = csv->next_id;
+        }
+        save_schema(schema, state_file);
+    }
+
+    free_csv_context(csv);
+    free_schema_context(schema);
     return 0;
 }
 
+/* Write the JSON statistics report to a file or stdout */
+static void write_stats_json(const char *path) {
+    if (strcmp(path, "-") == 0) {
+        print_stats_json(stdout);
+        return;
+    }
+
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "Error opening stats file %s for writing\n", path);
+        exit(1);
+    }
+    print_stats_json(file);
+    fclose(file);
+}
+
+/* Copy the value of an option that takes an argument */
+static char* option_value(int argc, char *argv[], int *i) {
+    if (*i + 1 >= argc) {
+        fprintf(stderr, "Error: %s requires an argument\n", argv[*i]);
+        exit(1);
+    }
+
+    char *value = strdup(argv[++*i]);
+    if (!value) {
+        fprintf(stderr, "Memory allocation failed for %s\n", argv[*i - 1]);
+        exit(1);
+    }
+    return value;
+}
+
 /* Parse command-line arguments */
-void parse_arguments(int argc, char *argv[], int *print_ast, char **out_dir) {
+void parse_arguments(int argc, char *argv[], Options *options) {
     /* Default values */
-    *print_ast = 0;
-    *out_dir = NULL;
-    
+    memset(options, 0, sizeof(*options));
+
+    /* Accounting starts before the options allocate anything, so every
+     * block it sees being freed was counted when it was allocated */
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--mem-stats") == 0) {
+            mem_accounting = 1;
+        } else if (strcmp(argv[i], "--mem-trace") == 0) {
+            mem_enable_trace();
+        }
+    }
+
     /* Parse arguments */
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--print-ast") == 0) {
-            *print_ast = 1;
-        } else if (strcmp(argv[i], "--out-dir") == 0) {
-            if (i + 1 < argc) {
-                *out_dir = strdup(argv[i + 1]);
-                if (!*out_dir) {
-                    fprintf(stderr, "Memory allocation failed for output directory\n");
-                    exit(1);
-                }
-                i++; /* Skip the next argument (directory name) */
+            options->print_ast = 1;
+        } else if (strcmp(argv[i], "--positions") == 0) {
+            options->positions = 1;
+        } else if (strcmp(argv[i], "--ast-format") == 0) {
+            char *name = option_value(argc, argv, &i);
+            if (strcmp(name, "tree") == 0) {
+                options->dump.format = AST_DUMP_TREE;
+            } else if (strcmp(name, "json") == 0) {
+                options->dump.format = AST_DUMP_JSON;
+            } else if (strcmp(name, "sexpr") == 0) {
+                options->dump.format = AST_DUMP_SEXPR;
+            } else {
+                fprintf(stderr, "Error: unknown AST format '%s' (expected tree, json or sexpr)\n", name);
+                exit(1);
+            }
+            options->dump_set = 1;
+            free(name);
+        } else if (strcmp(argv[i], "--max-depth") == 0) {
+            char *value = option_value(argc, argv, &i);
+            char *end;
+            long depth = strtol(value, &end, 10);
+            if (*end != '\0' || depth < 1 || depth > 1000000) {
+                fprintf(stderr, "Error: --max-depth expects a positive number, got '%s'\n", value);
+                exit(1);
+            }
+            options->dump.max_depth = (int)depth;
+            options->dump_set = 1;
+            free(value);
+        } else if (strcmp(argv[i], "--max-nodes") == 0) {
+            char *value = option_value(argc, argv, &i);
+            char *end;
+            long count = strtol(value, &end, 10);
+            if (*end != '\0' || count < 1) {
+                fprintf(stderr, "Error: --max-nodes expects a positive number, got '%s'\n", value);
+                exit(1);
+            }
+            options->dump.max_nodes = (unsigned long)count;
+            options->dump_set = 1;
+            free(value);
+        } else if (strcmp(argv[i], "--unify") == 0) {
+            options->unify = 1;
+        } else if (strcmp(argv[i], "--append") == 0) {
+            options->append = 1;
+        } else if (strcmp(argv[i], "--dedup") == 0) {
+            options->dedup = 1;
+        } else if (strcmp(argv[i], "--parser") == 0) {
+            char *name = option_value(argc, argv, &i);
+            if (strcmp(name, "bison") == 0) {
+                options->parser = PARSER_BISON;
+            } else if (strcmp(name, "iterative") == 0) {
+                options->parser = PARSER_ITERATIVE;
+            } else {
+                fprintf(stderr, "Error: unknown parser '%s' (expected bison or iterative)\n", name);
+                exit(1);
+            }
+            free(name);
+        } else if (strcmp(argv[i], "--select") == 0) {
+            char *paths = option_value(argc, argv, &i);
+            if (!options->select) {
+                options->select = create_selection();
+            }
+            add_selection_paths(options->select, paths);
+            free(paths);
+        } else if (strcmp(argv[i], "--where") == 0) {
+            char *expression = option_value(argc, argv, &i);
+            add_predicate(&options->where, expression);
+            free(expression);
+        } else if (strcmp(argv[i], "--validate-utf8") == 0) {
+            char *name = option_value(argc, argv, &i);
+            if (strcmp(name, "reject") == 0) {
+                options->utf8 = UTF8_REJECT;
+            } else if (strcmp(name, "replace") == 0) {
+                options->utf8 = UTF8_REPLACE;
             } else {
-                fprintf(stderr, "Error: --out-dir requires a directory name\n");
+                fprintf(stderr, "Error: unknown UTF-8 policy '%s' (expected reject or replace)\n", name);
+                exit(1);
+            }
+            free(name);
+        } else if (strcmp(argv[i], "--ids") == 0) {
+            char *name = option_value(argc, argv, &i);
+            if (strcmp(name, "dense") == 0) {
+                options->ids = ID_DENSE;
+            } else if (strcmp(name, "per-table") == 0) {
+                options->ids = ID_PER_TABLE;
+            } else {
+                fprintf(stderr, "Error: unknown ID strategy '%s' (expected dense or per-table)\n", name);
+                exit(1);
+            }
+            options->ids_set = 1;
+            free(name);
+        } else if (strcmp(argv[i], "--compress") == 0) {
+            char *name = option_value(argc, argv, &i);
+            if (!parse_codec(name, &options->compress)) {
+                fprintf(stderr, "Error: unknown codec '%s' (expected none, gzip or zstd)\n", name);
+                exit(1);
+            }
+            free(name);
+        } else if (strcmp(argv[i], "--input") == 0) {
+            free(options->input_file);
+            options->input_file = option_value(argc, argv, &i);
+        } else if (strcmp(argv[i], "--batch") == 0) {
+            free(options->batch);
+            options->batch = option_value(argc, argv, &i);
+        } else if (strcmp(argv[i], "--jobs") == 0) {
+            char *value = option_value(argc, argv, &i);
+            char *end;
+            long count = strtol(value, &end, 10);
+            if (*end != '\0' || count < 1 || count > 4096) {
+                fprintf(stderr, "Error: --jobs expects a positive number, got '%s'\n", value);
                 exit(1);
             }
+            options->jobs = (int)count;
+            free(value);
+        } else if (strcmp(argv[i], "--merge") == 0) {
+            options->merge = 1;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            options->stats = 1;
+        } else if (strcmp(argv[i], "--mem-stats") == 0) {
+            options->mem_stats = 1;
+        } else if (strcmp(argv[i], "--mem-trace") == 0) {
+            free(options->mem_trace_file);
+            options->mem_trace_file = option_value(argc, argv, &i);
+        } else if (strcmp(argv[i], "--stats-json") == 0) {
+            free(options->stats_json_file);
+            options->stats_json_file = option_value(argc, argv, &i);
+        } else if (strcmp(argv[i], "--out-dir") == 0) {
+            free(options->out_dir);
+            options->out_dir = option_value(argc, argv, &i);
+        } else if (strcmp(argv[i], "--sqlite") == 0) {
+            free(options->sqlite_file);
+            options->sqlite_file = option_value(argc, argv, &i);
+        } else if (strcmp(argv[i], "--schema") == 0) {
+            free(options->schema_file);
+            options->schema_file = option_value(argc, argv, &i);
+        } else if (strcmp(argv[i], "--save-schema") == 0) {
+            free(options->save_schema_file);
+            options->save_schema_file = option_value(argc, argv, &i);
         } else {
             fprintf(stderr, "Unknown argument: %s\n", argv[i]);
-            fprintf(stderr, "Usage: %s [--print-ast] [--out-dir DIR]\n", argv[0]);
+            fprintf(stderr, "Usage: %s [--print-ast [--positions] [--ast-format tree|json|sexpr] [--max-depth N] [--max-nodes N]] [--unify] [--append] [--dedup] [--ids dense|per-table] [--validate-utf8 reject|replace] [--select PATH[,PATH...]] [--where [TABLE:]EXPR] [--parser bison|iterative] [--stats] [--stats-json FILE] [--mem-stats] [--mem-trace FILE] [--input FILE] [--batch DIR|LIST [--merge]] [--jobs N] [--compress none|gzip|zstd] [--out-dir DIR] [--sqlite FILE] [--schema FILE] [--save-schema FILE]\n", argv[0]);
+            exit(1);
+        }
+    }
+
+    if (options->append && options->schema_file) {
+        fprintf(stderr, "Error: --append keeps its schema in the output directory and cannot be combined with --schema\n");
+        exit(1);
+    }
+
+    if (options->sqlite_file && options->compress != CODEC_NONE) {
+        fprintf(stderr, "Error: --compress applies to CSV output, not --sqlite\n");
+        exit(1);
+    }
+    if ((options->positions || options->dump_set) && !options->print_ast) {
+        fprintf(stderr, "Error: --positions, --ast-format, --max-depth and --max-nodes only apply to --print-ast\n");
+        exit(1);
+    }
+    json_track_positions = options->positions;
+    if (options->merge && !options->batch) {
+        fprintf(stderr, "Error: --merge only applies to --batch\n");
+        exit(1);
+    }
+    if (options->batch) {
+        if (options->input_file) {
+            fprintf(stderr, "Error: --batch reads its own inputs and cannot be combined with --input\n");
             exit(1);
         }
+
+        /* Per-file conversions run concurrently */
+        if (!options->merge && (options->print_ast || options->save_schema_file || options->sqlite_file)) {
+            fprintf(stderr, "Error: --print-ast, --save-schema and --sqlite need --merge in batch mode\n");
+            exit(1);
+        }
+        options->parser = PARSER_ITERATIVE;
+    }
+
+    /* Unselected members are skipped by the iterative parser's scanner */
+    if (options->select) {
+        finish_selection(options->select);
+        options->parser = PARSER_ITERATIVE;
     }
 }
@@ -0,0 +1,395 @@
+#include "mem.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+/*
+ * Memory accounting.
+ *
+ * With accounting on, every block is measured with the allocator's
+ * usable_size when it is allocated, resized or freed, and the category
+ * counters are updated atomically so batch and schema workers can share
+ * them. Tracing additionally keeps a table of live blocks, keyed by
+ * address, that points at the site that allocated each one.
+ */
+
+#ifdef __GLIBC__
+static size_t libc_usable_size(void *ptr) {
+    return malloc_usable_size(ptr);
+}
+static MemAllocator allocator = { malloc, calloc, realloc, free, libc_usable_size };
+#else
+static MemAllocator allocator = { malloc, calloc, realloc, free, NULL };
+#endif
+
+int mem_accounting = 0;
+static int mem_tracing = 0;
+
+static const char *category_names[MEM_CATEGORY_COUNT] = {
+    "input", "ast", "strings", "schema", "rows", "output"
+};
+
+/* One slot per category, then the totals */
+static MemCounters counters[MEM_CATEGORY_COUNT + 1];
+
+void mem_set_allocator(const MemAllocator *replacement) {
+    allocator = *replacement;
+}
+
+static size_t block_size(void *ptr) {
+    return allocator.usable_size ? allocator.usable_size(ptr) : 0;
+}
+
+static void raise_peak(size_t *peak, size_t value) {
+    size_t seen = __atomic_load_n(peak, __ATOMIC_RELAXED);
+    while (value > seen &&
+           !__atomic_compare_exchange_n(peak, &seen, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+/* Add bytes (or take them away) in a category and in the totals */
+static void count_bytes(MemCategory category, size_t added, size_t removed) {
+    MemCounters *slots[2] = { &counters[category], &counters[MEM_CATEGORY_COUNT] };
+    for (int i = 0; i < 2; i++) {
+        if (added >= removed) {
+            size_t held = __atomic_add_fetch(&slots[i]->bytes, added - removed, __ATOMIC_RELAXED);
+            raise_peak(&slots[i]->peak_bytes, held);
+        } else {
+            __atomic_sub_fetch(&slots[i]->bytes, removed - added, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/* ---- Allocation sites and live blocks (--mem-trace) ---- */
+
+typedef struct MemSite {
+    const char *file;
+    int line;
+    MemCategory category;
+    unsigned long allocations;   /* Blocks allocated or resized here */
+    unsigned long live;          /* Blocks from here not freed yet */
+    size_t bytes;                /* Bytes those blocks hold */
+    size_t peak_bytes;
+} MemSite;
+
+typedef struct MemBlock {
+    void *ptr;
+    size_t bytes;
+    int site;
+} MemBlock;
+
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static MemSite *sites = NULL;
+static int site_count = 0;
+static int site_capacity = 0;
+static int *site_index = NULL;        /* Open addressing over sites, -1 when empty */
+static size_t site_index_capacity = 0;
+static MemBlock *blocks = NULL;       /* Open addressing, ptr NULL when empty */
+static size_t block_capacity = 0;
+static size_t block_count = 0;
+
+static size_t hash_site(const char *file, int line, MemCategory category) {
+    uint64_t hash = (uint64_t)(uintptr_t)file * 0x9e3779b97f4a7c15ULL;
+    hash ^= (uint64_t)line * 0xff51afd7ed558ccdULL + (uint64_t)category;
+    return (size_t)(hash >> 17);
+}
+
+static size_t hash_block(const void *ptr) {
+    return (size_t)(((uint64_t)(uintptr_t)ptr * 0x9e3779b97f4a7c15ULL) >> 32);
+}
+
+static void* trace_table(size_t count, size_t size) {
+    /* Bypasses the accounting it implements */
+    void *table = calloc(count, size);
+    if (!table) {
+        fprintf(stderr, "Memory allocation failed for allocation trace\n");
+        exit(1);
+    }
+    return table;
+}
+
+/* Site of an allocation call; caller holds trace_lock */
+static MemSite* find_site(const char *file, int line, MemCategory category) {
+    if ((size_t)(site_count + 1) * 2 > site_index_capacity) {
+        free(site_index);
+        site_index_capacity = site_index_capacity ? site_index_capacity * 2 : 256;
+        site_index = (int*)trace_table(site_index_capacity, sizeof(int));
+        memset(site_index, 0xff, site_index_capacity * sizeof(int));
+        for (int i = 0; i < site_count; i++) {
+            size_t slot = hash_site(sites[i].file, sites[i].line, sites[i].category) & (site_index_capacity - 1);
+            while (site_index[slot] >= 0) {
+                slot = (slot + 1) & (site_index_capacity - 1);
+            }
+            site_index[slot] = i;
+        }
+    }
+
+    size_t slot = hash_site(file, line, category) & (site_index_capacity - 1);
+    while (site_index[slot] >= 0) {
+        MemSite *site = &sites[site_index[slot]];
+        if (site->file == file && site->line == line && site->category == category) {
+            return site;
+        }
+        slot = (slot + 1) & (site_index_capacity - 1);
+    }
+
+    if (site_count == site_capacity) {
+        site_capacity = site_capacity ? site_capacity * 2 : 128;
+        sites = (MemSite*)realloc(sites, site_capacity * sizeof(MemSite));
+        if (!sites) {
+            fprintf(stderr, "Memory allocation failed for allocation trace\n");
+            exit(1);
+        }
+    }
+    MemSite *site = &sites[site_count];
+    memset(site, 0, sizeof(*site));
+    site->file = file;
+    site->line = line;
+    site->category = category;
+    site_index[slot] = site_count++;
+    return site;
+}
+
+/* Slot holding ptr, or the empty slot where it would go */
+static size_t find_block(const void *ptr) {
+    size_t slot = hash_block(ptr) & (block_capacity - 1);
+    while (blocks[slot].ptr && blocks[slot].ptr != ptr) {
+        slot = (slot + 1) & (block_capacity - 1);
+    }
+    return slot;
+}
+
+/* Record a new block; caller holds trace_lock */
+static void trace_insert(void *ptr, size_t bytes, MemCategory category, const char *file, int line) {
+    if ((block_count + 1) * 2 > block_capacity) {
+        MemBlock *old_blocks = blocks;
+        size_t old_capacity = block_capacity;
+        block_capacity = block_capacity ? block_capacity * 2 : 4096;
+        blocks = (MemBlock*)trace_table(block_capacity, sizeof(MemBlock));
+        for (size_t i = 0; i < old_capacity; i++) {
+            if (old_blocks[i].ptr) {
+                blocks[find_block(old_blocks[i].ptr)] = old_blocks[i];
+            }
+        }
+        free(old_blocks);
+    }
+
+    MemSite *site = find_site(file, line, category);
+    site->allocations++;
+    site->live++;
+    site->bytes += bytes;
+    if (site->bytes > site->peak_bytes) {
+        site->peak_bytes = site->bytes;
+    }
+
+    size_t slot = find_block(ptr);
+    if (!blocks[slot].ptr) {
+        block_count++;
+    }
+    blocks[slot].ptr = ptr;
+    blocks[slot].bytes = bytes;
+    blocks[slot].site = (int)(site - sites);
+}
+
+/* Forget a block, shifting later entries of its probe run back; caller
+ * holds trace_lock */
+static void trace_remove(void *ptr) {
+    size_t hole = block_capacity ? find_block(ptr) : 0;
+    if (!block_capacity || !blocks[hole].ptr) {
+        /* Allocated before tracing started */
+        return;
+    }
+    MemSite *site = &sites[blocks[hole].site];
+    site->live--;
+    site->bytes -= blocks[hole].bytes;
+    block_count--;
+
+    size_t mask = block_capacity - 1;
+    size_t next = hole;
+    for (;;) {
+        blocks[hole].ptr = NULL;
+        for (;;) {
+            next = (next + 1) & mask;
+            if (!blocks[next].ptr) {
+                return;
+            }
+            /* The entry may fill the hole unless its home lies in (hole, next] */
+            size_t home = hash_block(blocks[next].ptr) & mask;
+            if (((next - home) & mask) >= ((next - hole) & mask)) {
+                break;
+            }
+        }
+        blocks[hole] = blocks[next];
+        hole = next;
+    }
+}
+
+static void trace_alloc(void *ptr, size_t bytes, MemCategory category, const char *file, int line) {
+    pthread_mutex_lock(&trace_lock);
+    trace_insert(ptr, bytes, category, file, line);
+    pthread_mutex_unlock(&trace_lock);
+}
+
+static void trace_free(void *ptr) {
+    pthread_mutex_lock(&trace_lock);
+    trace_remove(ptr);
+    pthread_mutex_unlock(&trace_lock);
+}
+
+void mem_enable_trace(void) {
+    mem_accounting = 1;
+    mem_tracing = 1;
+}
+
+/* ---- Entry points ---- */
+
+static void* account_new(MemCategory category, void *ptr, const char *file, int line) {
+    if (ptr) {
+        size_t bytes = block_size(ptr);
+        __atomic_fetch_add(&counters[category].allocations, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&counters[MEM_CATEGORY_COUNT].allocations, 1, __ATOMIC_RELAXED);
+        count_bytes(category, bytes, 0);
+        if (mem_tracing) {
+            trace_alloc(ptr, bytes, category, file, line);
+        }
+    }
+    return ptr;
+}
+
+void* mem_alloc_at(MemCategory category, size_t size, const char *file, int line) {
+    void *ptr = allocator.alloc(size);
+    return mem_accounting ? account_new(category, ptr, file, line) : ptr;
+}
+
+void* mem_calloc_at(MemCategory category, size_t count, size_t size, const char *file, int line) {
+    void *ptr = allocator.alloc_zeroed(count, size);
+    return mem_accounting ? account_new(category, ptr, file, line) : ptr;
+}
+
+void* mem_realloc_at(MemCategory category, void *ptr, size_t size, const char *file, int line) {
+    if (!mem_accounting) {
+        return allocator.resize(ptr, size);
+    }
+    if (!ptr) {
+        return account_new(category, allocator.resize(NULL, size), file, line);
+    }
+
+    size_t old_bytes = block_size(ptr);
+    if (!mem_tracing) {
+        void *resized = allocator.resize(ptr, size);
+        if (resized) {
+            count_bytes(category, block_size(resized), old_bytes);
+        }
+        return resized;
+    }
+
+    /* Once the old block is released another thread can be handed its
+     * address, so the entry must be replaced before anyone may record it */
+    pthread_mutex_lock(&trace_lock);
+    void *resized = allocator.resize(ptr, size);
+    if (resized) {
+        size_t new_bytes = block_size(resized);
+        count_bytes(category, new_bytes, old_bytes);
+        trace_remove(ptr);
+        trace_insert(resized, new_bytes, category, file, line);
+    }
+    pthread_mutex_unlock(&trace_lock);
+    return resized;
+}
+
+char* mem_strdup_at(MemCategory category, const char *str, const char *file, int line) {
+    size_t length = strlen(str) + 1;
+    char *copy = (char*)mem_alloc_at(category, length, file, line);
+    if (copy) {
+        memcpy(copy, str, length);
+    }
+    return copy;
+}
+
+void mem_free(MemCategory category, void *ptr) {
+    if (!ptr) {
+        return;
+    }
+    if (mem_accounting) {
+        __atomic_fetch_add(&counters[category].frees, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&counters[MEM_CATEGORY_COUNT].frees, 1, __ATOMIC_RELAXED);
+        count_bytes(category, 0, block_size(ptr));
+        if (mem_tracing) {
+            trace_free(ptr);
+        }
+    }
+    allocator.release(ptr);
+}
+
+/* ---- Reporting ---- */
+
+void mem_counters(MemCategory category, MemCounters *out) {
+    const MemCounters *slot = &counters[category];
+    out->allocations = __atomic_load_n(&slot->allocations, __ATOMIC_RELAXED);
+    out->frees = __atomic_load_n(&slot->frees, __ATOMIC_RELAXED);
+    out->bytes = __atomic_load_n(&slot->bytes, __ATOMIC_RELAXED);
+    out->peak_bytes = __atomic_load_n(&slot->peak_bytes, __ATOMIC_RELAXED);
+}
+
+void print_mem_stats(FILE *out) {
+    fprintf(out, "%-10s %12s %12s %14s %14s\n", "memory", "allocs", "frees", "bytes", "peak_bytes");
+    for (int i = 0; i <= MEM_CATEGORY_COUNT; i++) {
+        MemCounters c;
+        mem_counters((MemCategory)i, &c);
+        fprintf(out, "%-10s %12lu %12lu %14zu %14zu\n",
+                i < MEM_CATEGORY_COUNT ? category_names[i] : "total",
+                c.allocations, c.frees, c.bytes, c.peak_bytes);
+    }
+}
+
+void print_mem_stats_json(FILE *out) {
+    fprintf(out, "{");
+    for (int i = 0; i <= MEM_CATEGORY_COUNT; i++) {
+        MemCounters c;
+        mem_counters((MemCategory)i, &c);
+        fprintf(out, "%s\"%s\": {\"allocations\": %lu, \"frees\": %lu, \"bytes\": %zu, \"peak_bytes\": %zu}",
+                i ? ", " : "", i < MEM_CATEGORY_COUNT ? category_names[i] : "total",
+                c.allocations, c.frees, c.bytes, c.peak_bytes);
+    }
+    fprintf(out, "}");
+}
+
+static int compare_sites(const void *a, const void *b) {
+    const MemSite *sa = (const MemSite*)a;
+    const MemSite *sb = (const MemSite*)b;
+    if (sa->peak_bytes != sb->peak_bytes) {
+        return sa->peak_bytes < sb->peak_bytes ? 1 : -1;
+    }
+    return sa->allocations < sb->allocations ? 1 : sa->allocations > sb->allocations ? -1 : 0;
+}
+
+int write_mem_trace(const char *path) {
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        return 1;
+    }
+
+    pthread_mutex_lock(&trace_lock);
+    MemSite *sorted = (MemSite*)trace_table(site_count ? site_count : 1, sizeof(MemSite));
+    memcpy(sorted, sites, site_count * sizeof(MemSite));
+    int count = site_count;
+    pthread_mutex_unlock(&trace_lock);
+
+    qsort(sorted, count, sizeof(MemSite), compare_sites);
+
+    /* Blocks still live at this point were never freed */
+    fprintf(out, "%-28s %-8s %12s %10s %14s %14s\n", "site", "category", "allocations", "live", "live_bytes", "peak_bytes");
+    for (int i = 0; i < count; i++) {
+        char site[64];
+        snprintf(site, sizeof(site), "%s:%d", sorted[i].file, sorted[i].line);
+        fprintf(out, "%-28s %-8s %12lu %10lu %14zu %14zu\n", site, category_names[sorted[i].category],
+                sorted[i].allocations, sorted[i].live, sorted[i].bytes, sorted[i].peak_bytes);
+    }
+    free(sorted);
+
+    return fclose(out) != 0;
+}
@@ -0,0 +1,76 @@
+#ifndef MEM_H
+#define MEM_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+/* Subsystems whose memory is accounted separately. Not counted: the
+ * command-line option strings, getline buffers for list and schema files,
+ * strings returned by escape_csv_field (freed by the caller with free),
+ * and whatever zlib, zstd, SQLite and the C library allocate internally. */
+typedef enum {
+    MEM_INPUT,      /* Input text, decompression, parser stacks and the batch file list */
+    MEM_AST,        /* JsonValue nodes, pairs, elements and AST walks */
+    MEM_STRINGS,    /* Decoded string values and keys */
+    MEM_SCHEMA,     /* Tables, columns, signatures, --select and --where */
+    MEM_ROWS,       /* Extracted rows, junction data and the dedup index */
+    MEM_OUTPUT,     /* Output buffers, pooled files and write requests */
+    MEM_CATEGORY_COUNT
+} MemCategory;
+
+/* Allocator underneath the accounting layer; the default is the C
+ * library's. usable_size reports the bytes really reserved for a block
+ * and may be NULL, in which case nothing is counted as bytes. */
+typedef struct MemAllocator {
+    void* (*alloc)(size_t size);
+    void* (*alloc_zeroed)(size_t count, size_t size);
+    void* (*resize)(void *ptr, size_t size);
+    void (*release)(void *ptr);
+    size_t (*usable_size)(void *ptr);
+} MemAllocator;
+
+/* Replace the allocator; only before anything has been allocated */
+void mem_set_allocator(const MemAllocator *allocator);
+
+/* Counters of one category (or of all of them) */
+typedef struct MemCounters {
+    unsigned long allocations;
+    unsigned long frees;
+    size_t bytes;          /* Held now */
+    size_t peak_bytes;     /* High-water mark of bytes */
+} MemCounters;
+
+/* Count allocations per category (--mem-stats). Off by default, when the
+ * functions below just forward to the allocator. */
+extern int mem_accounting;
+
+/* Also record every allocation site and the blocks each one holds
+ * (--mem-trace); turns accounting on */
+void mem_enable_trace(void);
+
+/* Allocation entry points; each behaves like its C library counterpart
+ * and returns NULL on failure. A block must be freed or resized under the
+ * category it was allocated with. */
+void* mem_alloc_at(MemCategory category, size_t size, const char *file, int line);
+void* mem_calloc_at(MemCategory category, size_t count, size_t size, const char *file, int line);
+void* mem_realloc_at(MemCategory category, void *ptr, size_t size, const char *file, int line);
+char* mem_strdup_at(MemCategory category, const char *str, const char *file, int line);
+void mem_free(MemCategory category, void *ptr);
+
+#define mem_alloc(category, size) mem_alloc_at(category, size, __FILE__, __LINE__)
+#define mem_calloc(category, count, size) mem_calloc_at(category, count, size, __FILE__, __LINE__)
+#define mem_realloc(category, ptr, size) mem_realloc_at(category, ptr, size, __FILE__, __LINE__)
+#define mem_strdup(category, str) mem_strdup_at(category, str, __FILE__, __LINE__)
+
+/* Counters of one category; MEM_CATEGORY_COUNT gives the totals, whose
+ * peak is the high-water mark of all categories together */
+void mem_counters(MemCategory category, MemCounters *out);
+
+/* Reporting: a table of the counters, the same as a JSON object, and the
+ * per-site trace sorted by peak bytes (returns nonzero if path cannot be
+ * written) */
+void print_mem_stats(FILE *out);
+void print_mem_stats_json(FILE *out);
+int write_mem_trace(const char *path);
+
+#endif /* MEM_H */
@@ -0,0 +1,347 @@
+#include "number_format.h"
+#include <string.h>
+
+/*
+ * Shortest round-trip double formatting after Florian Loitsch, "Printing
+ * Floating-Point Numbers Quickly and Accurately with Integers" (Grisu2).
+ * The digits always read back as the original double, and for almost all
+ * values they are also the shortest such digit string.
+ */
+
+/* Unsigned 64-bit significand with a binary exponent: f * 2^e */
+typedef struct DiyFp {
+    uint64_t f;
+    int e;
+} DiyFp;
+
+#define DP_SIGNIFICAND_BITS 52
+#define DP_HIDDEN_BIT 0x0010000000000000ULL
+#define DP_SIGNIFICAND_MASK 0x000FFFFFFFFFFFFFULL
+#define DP_EXPONENT_BIAS (0x3FF + DP_SIGNIFICAND_BITS)
+
+/* Normalized 10^k for k = -348, -340, ..., 340 */
+static const DiyFp cached_powers[] = {
+    {0xfa8fd5a0081c0288ULL, -1220}, {0xbaaee17fa23ebf76ULL, -1193},
+    {0x8b16fb203055ac76ULL, -1166}, {0xcf42894a5dce35eaULL, -1140},
+    {0x9a6bb0aa55653b2dULL, -1113}, {0xe61acf033d1a45dfULL, -1087},
+    {0xab70fe17c79ac6caULL, -1060}, {0xff77b1fcbebcdc4fULL, -1034},
+    {0xbe5691ef416bd60cULL, -1007}, {0x8dd01fad907ffc3cULL, -980},
+    {0xd3515c2831559a83ULL, -954}, {0x9d71ac8fada6c9b5ULL, -927},
+    {0xea9c227723ee8bcbULL, -901}, {0xaecc49914078536dULL, -874},
+    {0x823c12795db6ce57ULL, -847}, {0xc21094364dfb5637ULL, -821},
+    {0x9096ea6f3848984fULL, -794}, {0xd77485cb25823ac7ULL, -768},
+    {0xa086cfcd97bf97f4ULL, -741}, {0xef340a98172aace5ULL, -715},
+    {0xb23867fb2a35b28eULL, -688}, {0x84c8d4dfd2c63f3bULL, -661},
+    {0xc5dd44271ad3cdbaULL, -635}, {0x936b9fcebb25c996ULL, -608},
+    {0xdbac6c247d62a584ULL, -582}, {0xa3ab66580d5fdaf6ULL, -555},
+    {0xf3e2f893dec3f126ULL, -529}, {0xb5b5ada8aaff80b8ULL, -502},
+    {0x87625f056c7c4a8bULL, -475}, {0xc9bcff6034c13053ULL, -449},
+    {0x964e858c91ba2655ULL, -422}, {0xdff9772470297ebdULL, -396},
+    {0xa6dfbd9fb8e5b88fULL, -369}, {0xf8a95fcf88747d94ULL, -343},
+    {0xb94470938fa89bcfULL, -316}, {0x8a08f0f8bf0f156bULL, -289},
+    {0xcdb02555653131b6ULL, -263}, {0x993fe2c6d07b7facULL, -236},
+    {0xe45c10c42a2b3b06ULL, -210}, {0xaa242499697392d3ULL, -183},
+    {0xfd87b5f28300ca0eULL, -157}, {0xbce5086492111aebULL, -130},
+    {0x8cbccc096f5088ccULL, -103}, {0xd1b71758e219652cULL, -77},
+    {0x9c40000000000000ULL, -50}, {0xe8d4a51000000000ULL, -24},
+    {0xad78ebc5ac620000ULL, 3}, {0x813f3978f8940984ULL, 30},
+    {0xc097ce7bc90715b3ULL, 56}, {0x8f7e32ce7bea5c70ULL, 83},
+    {0xd5d238a4abe98068ULL, 109}, {0x9f4f2726179a2245ULL, 136},
+    {0xed63a231d4c4fb27ULL, 162}, {0xb0de65388cc8ada8ULL, 189},
+    {0x83c7088e1aab65dbULL, 216}, {0xc45d1df942711d9aULL, 242},
+    {0x924d692ca61be758ULL, 269}, {0xda01ee641a708deaULL, 295},
+    {0xa26da3999aef774aULL, 322}, {0xf209787bb47d6b85ULL, 348},
+    {0xb454e4a179dd1877ULL, 375}, {0x865b86925b9bc5c2ULL, 402},
+    {0xc83553c5c8965d3dULL, 428}, {0x952ab45cfa97a0b3ULL, 455},
+    {0xde469fbd99a05fe3ULL, 481}, {0xa59bc234db398c25ULL, 508},
+    {0xf6c69a72a3989f5cULL, 534}, {0xb7dcbf5354e9beceULL, 561},
+    {0x88fcf317f22241e2ULL, 588}, {0xcc20ce9bd35c78a5ULL, 614},
+    {0x98165af37b2153dfULL, 641}, {0xe2a0b5dc971f303aULL, 667},
+    {0xa8d9d1535ce3b396ULL, 694}, {0xfb9b7cd9a4a7443cULL, 720},
+    {0xbb764c4ca7a44410ULL, 747}, {0x8bab8eefb6409c1aULL, 774},
+    {0xd01fef10a657842cULL, 800}, {0x9b10a4e5e9913129ULL, 827},
+    {0xe7109bfba19c0c9dULL, 853}, {0xac2820d9623bf429ULL, 880},
+    {0x80444b5e7aa7cf85ULL, 907}, {0xbf21e44003acdd2dULL, 933},
+    {0x8e679c2f5e44ff8fULL, 960}, {0xd433179d9c8cb841ULL, 986},
+    {0x9e19db92b4e31ba9ULL, 1013}, {0xeb96bf6ebadf77d9ULL, 1039},
+    {0xaf87023b9bf0ee6bULL, 1066}
+};
+
+static const uint64_t pow10_table[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+    100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL,
+    10000000000000ULL, 100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+    100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
+/* Split a positive double into significand and exponent */
+static DiyFp diyfp_from_double(double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+
+    int biased_e = (int)((bits >> DP_SIGNIFICAND_BITS) & 0x7FF);
+    uint64_t significand = bits & DP_SIGNIFICAND_MASK;
+    DiyFp result;
+    if (biased_e != 0) {
+        result.f = significand + DP_HIDDEN_BIT;
+        result.e = biased_e - DP_EXPONENT_BIAS;
+    } else {
+        result.f = significand;  /* Subnormal */
+        result.e = 1 - DP_EXPONENT_BIAS;
+    }
+    return result;
+}
+
+/* Shift left until the top bit is set */
+static DiyFp diyfp_normalize(DiyFp x) {
+    while (!(x.f & 0x8000000000000000ULL)) {
+        x.f <<= 1;
+        x.e--;
+    }
+    return x;
+}
+
+/* Rounded product of two normalized values, keeping the upper 64 bits */
+static DiyFp diyfp_multiply(DiyFp a, DiyFp b) {
+    unsigned __int128 product = (unsigned __int128)a.f * b.f;
+    DiyFp result;
+    result.f = (uint64_t)(product >> 64);
+    if ((uint64_t)product & 0x8000000000000000ULL) {
+        result.f++;
+    }
+    result.e = a.e + b.e + 64;
+    return result;
+}
+
+/* Boundaries halfway to the neighbouring doubles, sharing one exponent */
+static void normalized_boundaries(DiyFp v, DiyFp *minus, DiyFp *plus) {
+    DiyFp pl = {(v.f << 1) + 1, v.e - 1};
+    while (!(pl.f & (DP_HIDDEN_BIT << 1))) {
+        pl.f <<= 1;
+        pl.e--;
+    }
+    pl.f <<= 64 - DP_SIGNIFICAND_BITS - 2;
+    pl.e -= 64 - DP_SIGNIFICAND_BITS - 2;
+
+    /* The gap below a power of two is half as wide */
+    DiyFp mi;
+    if (v.f == DP_HIDDEN_BIT) {
+        mi.f = (v.f << 2) - 1;
+        mi.e = v.e - 2;
+    } else {
+        mi.f = (v.f << 1) - 1;
+        mi.e = v.e - 1;
+    }
+    mi.f <<= mi.e - pl.e;
+    mi.e = pl.e;
+
+    *minus = mi;
+    *plus = pl;
+}
+
+/* Cached power of ten that scales a binary exponent e into [-60, -32];
+ * stores the negated decimal exponent in k */
+static DiyFp cached_power(int e, int *k) {
+    double dk = (-61 - e) * 0.30102999566398114 + 347;
+    int ik = (int)dk;
+    if (dk - ik > 0.0) {
+        ik++;
+    }
+    unsigned index = (unsigned)((ik >> 3) + 1);
+    *k = -(-348 + (int)(index << 3));
+    return cached_powers[index];
+}
+
+/* Move the last digit towards the exact value while staying in range */
+static void grisu_round(char *buffer, int length, uint64_t delta, uint64_t rest,
+                        uint64_t ten_kappa, uint64_t wp_w) {
+    while (rest < wp_w && delta - rest >= ten_kappa &&
+           (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w)) {
+        buffer[length - 1]--;
+        rest += ten_kappa;
+    }
+}
+
+/* Number of decimal digits of a 32-bit value */
+static int count_digits(uint32_t n) {
+    int digits = 1;
+    while (digits < 10 && n >= pow10_table[digits]) {
+        digits++;
+    }
+    return digits;
+}
+
+/* Generate the shortest digits of w inside the interval (mp - delta, mp) */
+static void digit_gen(DiyFp w, DiyFp mp, uint64_t delta, char *buffer, int *length, int *k) {
+    DiyFp one = {1ULL << -mp.e, mp.e};
+    uint64_t wp_w = mp.f - w.f;
+    uint32_t p1 = (uint32_t)(mp.f >> -one.e);
+    uint64_t p2 = mp.f & (one.f - 1);
+    int kappa = count_digits(p1);
+    *length = 0;
+
+    /* Integral part */
+    while (kappa > 0) {
+        uint32_t divisor = (uint32_t)pow10_table[kappa - 1];
+        uint32_t digit = p1 / divisor;
+        p1 %= divisor;
+        if (digit || *length) {
+            buffer[(*length)++] = (char)('0' + digit);
+        }
+        kappa--;
+
+        uint64_t rest = ((uint64_t)p1 << -one.e) + p2;
+        if (rest <= delta) {
+            *k += kappa;
+            grisu_round(buffer, *length, delta, rest, pow10_table[kappa] << -one.e, wp_w);
+            return;
+        }
+    }
+
+    /* Fractional part */
+    for (;;) {
+        p2 *= 10;
+        delta *= 10;
+        char digit = (char)(p2 >> -one.e);
+        if (digit || *length) {
+            buffer[(*length)++] = (char)('0' + digit);
+        }
+        p2 &= one.f - 1;
+        kappa--;
+        if (p2 < delta) {
+            *k += kappa;
+            int index = -kappa;
+            grisu_round(buffer, *length, delta, p2, one.f, wp_w * (index < 20 ? pow10_table[index] : 0));
+            return;
+        }
+    }
+}
+
+/* Digits and decimal exponent of a positive double: value = digits * 10^k */
+static void grisu2(double value, char *buffer, int *length, int *k) {
+    DiyFp v = diyfp_from_double(value);
+    DiyFp w_minus, w_plus;
+    normalized_boundaries(v, &w_minus, &w_plus);
+
+    DiyFp c_mk = cached_power(w_plus.e, k);
+    DiyFp w = diyfp_multiply(diyfp_normalize(v), c_mk);
+    DiyFp wp = diyfp_multiply(w_plus, c_mk);
+    DiyFp wm = diyfp_multiply(w_minus, c_mk);
+    wm.f++;
+    wp.f--;
+    digit_gen(w, wp, wp.f - wm.f, buffer, length, k);
+}
+
+/* Write "e-7" / "e21" style exponents */
+static char* write_exponent(int exponent, char *out) {
+    *out++ = 'e';
+    if (exponent < 0) {
+        *out++ = '-';
+        exponent = -exponent;
+    }
+    if (exponent >= 100) {
+        *out++ = (char)('0' + exponent / 100);
+        exponent %= 100;
+        *out++ = (char)('0' + exponent / 10);
+    } else if (exponent >= 10) {
+        *out++ = (char)('0' + exponent / 10);
+    }
+    *out++ = (char)('0' + exponent % 10);
+    return out;
+}
+
+/* Lay out digits * 10^k as plain decimal or exponent notation */
+static int prettify(char *buffer, int length, int k) {
+    int kk = length + k;  /* 10^(kk-1) <= value < 10^kk */
+
+    if (k >= 0 && kk <= 21) {
+        /* 1234e7 -> 12340000000 */
+        memset(buffer + length, '0', k);
+        buffer[kk] = '\0';
+        return kk;
+    }
+    if (kk > 0 && kk <= 21) {
+        /* 1234e-2 -> 12.34 */
+        memmove(buffer + kk + 1, buffer + kk, length - kk);
+        buffer[kk] = '.';
+        buffer[length + 1] = '\0';
+        return length + 1;
+    }
+    if (kk > -6 && kk <= 0) {
+        /* 1234e-6 -> 0.001234 */
+        int offset = 2 - kk;
+        memmove(buffer + offset, buffer, length);
+        buffer[0] = '0';
+        buffer[1] = '.';
+        memset(buffer + 2, '0', offset - 2);
+        buffer[length + offset] = '\0';
+        return length + offset;
+    }
+
+    char *end;
+    if (length == 1) {
+        /* 1e30 */
+        end = write_exponent(kk - 1, buffer + 1);
+    } else {
+        /* 1234e30 -> 1.234e33 */
+        memmove(buffer + 2, buffer + 1, length - 1);
+        buffer[1] = '.';
+        end = write_exponent(kk - 1, buffer + length + 1);
+    }
+    *end = '\0';
+    return (int)(end - buffer);
+}
+
+/* Format a 64-bit integer; returns the length */
+int format_int64(int64_t value, char *out) {
+    char digits[24];
+    int pos = sizeof(digits);
+    uint64_t magnitude = value < 0 ? 0 - (uint64_t)value : (uint64_t)value;
+
+    do {
+        digits[--pos] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+    if (value < 0) {
+        digits[--pos] = '-';
+    }
+
+    int length = (int)sizeof(digits) - pos;
+    memcpy(out, digits + pos, length);
+    out[length] = '\0';
+    return length;
+}
+
+/* Format a double with the fewest digits that read back as the same value */
+int format_double(double value, char *out) {
+    /* JSON has no NaN or infinity, but never emit garbage for them */
+    if (value != value) {
+        strcpy(out, "nan");
+        return 3;
+    }
+
+    int sign = 0;
+    if (value < 0 || (value == 0 && 1 / value < 0)) {
+        *out = '-';
+        sign = 1;
+        value = -value;
+    }
+
+    if (value == 0) {
+        strcpy(out + sign, "0");
+        return sign + 1;
+    }
+    if (value > 1.7976931348623157e308) {
+        strcpy(out + sign, "inf");
+        return sign + 3;
+    }
+
+    /* Integral values below 2^53 are exact as integers */
+    if (value < 9007199254740992.0 && (double)(int64_t)value == value) {
+        return sign + format_int64((int64_t)value, out + sign);
+    }
+
+    int length, k;
+    grisu2(value, out + sign, &length, &k);
+    return sign + prettify(out + sign, length, k);
+}
@@ -0,0 +1,26 @@
+#ifndef NUMBER_FORMAT_H
+#define NUMBER_FORMAT_H
+
+#include <stdint.h>
+
+/* Room needed for any formatted number, including the terminator */
+#define NUMBER_FORMAT_MAX 32
+
+/* Format a double with the fewest digits that read back as the same value
+ * (Grisu2). Integral values print without a fraction or exponent; very
+ * large or small magnitudes use exponent notation ("1.5e-7", "2e21").
+ * Writes a terminated string to out and returns its length. */
+int format_double(double value, char *out);
+
+/* Format a 64-bit integer; returns the length */
+int format_int64(int64_t value, char *out);
+
+/* Whether value is integral and below 2^53 in magnitude, so it converts
+ * to int64_t exactly. Inference only makes such columns COL_INTEGER, but a
+ * loaded schema can declare any column integer. */
+static inline int number_is_exact_integer(double value) {
+    return value > -9007199254740992.0 && value < 9007199254740992.0 &&
+           (double)(int64_t)value == value;
+}
+
+#endif /* NUMBER_FORMAT_H */
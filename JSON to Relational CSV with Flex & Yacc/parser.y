@@ -27,16 +27,40 @@ void debug_print(const char *msg) {
 }
 %}
 
+/* Values are built by value on the parser stack and copied into the pair
+ * or element that holds them, so each member is a single allocation. Pair
+ * and element lists carry their tail to append in constant time. */
+%code requires {
+#include "ast.h"
+
+typedef struct PairList {
+    KeyValuePair *head;
+    KeyValuePair *tail;
+} PairList;
+
+typedef struct ElementList {
+    ArrayElement *head;
+    ArrayElement *tail;
+} ElementList;
+
+/* A decoded string token: text that fits inline in a node travels in the
+ * token itself, longer text in a heap copy */
+typedef struct StringToken {
+    char *heap;
+    char buffer[JSON_INLINE_MAX + 1];
+} StringToken;
+}
+
 /* Define value types */
 %union {
     double dval;
-    char *sval;
+    StringToken sval;
     int bval;
-    JsonValue *json_val;
+    JsonValue json_val;
     KeyValuePair *kv_pair;
-    KeyValuePair *kv_list;
+    PairList kv_list;
     ArrayElement *arr_elem;
-    ArrayElement *arr_list;
+    ElementList arr_list;
 }
 
 /* Define tokens */
@@ -63,7 +87,9 @@ void debug_print(const char *msg) {
 json:
     json_value  { 
         debug_print("Completed parsing JSON value");
-        json_root = $1; 
+        json_root = new_json_value();
+        *json_root = $1;
+        set_json_position(json_root, @1.first_line, @1.first_column);
     }
     ;
 
@@ -78,47 +104,43 @@ json_value:
     }
     | STRING          { 
         debug_print("Parsed string");
-        $$ = create_string($1, @1.first_line, @1.first_column); free($1); 
+        if ($1.heap) {
+            init_string_owned(&$$, $1.heap);
+        } else {
+            init_string(&$$, $1.buffer);
+        }
     }
     | NUMBER          { 
         debug_print("Parsed number");
-        $$ = create_number($1, @1.first_line, @1.first_column); 
+        init_number(&$$, $1); 
     }
     | TRUE            { 
         debug_print("Parsed true");
-        $$ = create_boolean(1, @1.first_line, @1.first_column); 
+        init_boolean(&$$, 1); 
     }
     | FALSE           { 
         debug_print("Parsed false");
-        $$ = create_boolean(0, @1.first_line, @1.first_column); 
+        init_boolean(&$$, 0); 
     }
     | NUL             { 
         debug_print("Parsed null");
-        $$ = create_null(@1.first_line, @1.first_column); 
+        init_null(&$$); 
     }
     ;
 
 json_object:
     LBRACE RBRACE                 { 
         debug_print("Parsed empty object {}");
-        $$ = create_object(@1.first_line, @1.first_column); 
+        init_object(&$$); 
     }
     | LBRACE json_pairs RBRACE    { 
         debug_print("Parsed object with key-value pairs");
-        $$ = create_object(@1.first_line, @1.first_column);
-                                     
-        /* Add all key-value pairs to the object */
-        KeyValuePair *pair = $2;
-        while (pair) {
-            KeyValuePair *next = pair->next;
-            pair->next = NULL;
-            add_key_value($$, pair->key, pair->value);
-            if (DEBUG_PARSER) {
+        init_object(&$$);
+        $$.value.object_head = $2.head;
+        if (DEBUG_PARSER) {
+            for (KeyValuePair *pair = $2.head; pair; pair = pair->next) {
                 fprintf(stderr, "PARSER: Added key '%s' to object\n", pair->key);
             }
-            free(pair->key);
-            free(pair);
-            pair = next;
         }
     }
     ;
@@ -126,92 +148,62 @@ json_object:
 json_pairs:
     json_pair                     { 
         debug_print("Parsed first key-value pair");
-        $$ = $1; 
+        $$.head = $1;
+        $$.tail = $1;
     }
     | json_pairs COMMA json_pair  { 
         debug_print("Parsed additional key-value pair");
         /* Add new pair to the end of the list */
-        if ($1) {
-            KeyValuePair *current = $1;
-            while (current->next) {
-                current = current->next;
-            }
-            current->next = $3;
-            $$ = $1;
-        } else {
-            $$ = $3;
-        }
+        $1.tail->next = $3;
+        $$.head = $1.head;
+        $$.tail = $3;
     }
     ;
 
 json_pair:
     STRING COLON json_value       { 
+        $$ = $1.heap ? new_key_value($1.heap) : new_key_value_copy($1.buffer);
         if (DEBUG_PARSER) {
-            fprintf(stderr, "PARSER: Created key-value pair for key '%s'\n", $1);
-        }
-        $$ = (KeyValuePair*)malloc(sizeof(KeyValuePair));
-        if (!$$) {
-            yyerror("Memory allocation failed");
-            exit(1);
+            fprintf(stderr, "PARSER: Created key-value pair for key '%s'\n", $$->key);
         }
-        $$->key = $1;
         $$->value = $3;
-        $$->next = NULL;
+        set_json_position(&$$->value, @3.first_line, @3.first_column);
     }
     ;
 
 json_array:
     LBRACKET RBRACKET             { 
         debug_print("Parsed empty array []");
-        $$ = create_array(@1.first_line, @1.first_column); 
+        init_array(&$$); 
     }
     | LBRACKET json_elements RBRACKET {
         debug_print("Parsed array with elements");
-        $$ = create_array(@1.first_line, @1.first_column);
-                                     
-        /* Add all elements to the array */
-        ArrayElement *elem = $2;
-        while (elem) {
-            ArrayElement *next = elem->next;
-            elem->next = NULL;
-            add_array_element($$, elem->value);
-            free(elem);
-            elem = next;
-        }
+        init_array(&$$);
+        $$.value.array_head = $2.head;
     }
     ;
 
 json_elements:
     json_element                      { 
         debug_print("Parsed first array element");
-        $$ = $1; 
+        $$.head = $1;
+        $$.tail = $1;
     }
     | json_elements COMMA json_element {
         debug_print("Parsed additional array element");
         /* Add new element to the end of the list */
-        if ($1) {
-            ArrayElement *current = $1;
-            while (current->next) {
-                current = current->next;
-            }
-            current->next = $3;
-            $$ = $1;
-        } else {
-            $$ = $3;
-        }
+        $1.tail->next = $3;
+        $$.head = $1.head;
+        $$.tail = $3;
     }
     ;
 
 json_element:
     json_value                     {
         debug_print("Created array element");
-        $$ = (ArrayElement*)malloc(sizeof(ArrayElement));
-        if (!$$) {
-            yyerror("Memory allocation failed");
-            exit(1);
-        }
+        $$ = new_array_element();
         $$->value = $1;
-        $$->next = NULL;
+        set_json_position(&$$->value, @1.first_line, @1.first_column);
     }
     ;
 
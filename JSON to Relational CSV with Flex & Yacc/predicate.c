@@ -0,0 +1,463 @@
+#include "predicate.h"
+#include "json_string.h"
+#include "mem.h"
+#include <ctype.h>
+
+/* Compiler state: a recursive-descent parser over the expression text
+ * that emits postfix instructions as it goes */
+typedef struct PredicateCompiler {
+    const char *text;   /* Whole option value, for error messages */
+    const char *p;
+    Predicate *predicate;
+    int nesting;        /* Open '(' and '!' being parsed */
+} PredicateCompiler;
+
+/* Report a syntax error at the current position and exit */
+static void predicate_error(PredicateCompiler *compiler, const char *msg) {
+    fprintf(stderr, "Error: invalid --where expression: %s at offset %d\n  %s\n  %*s^\n",
+            msg, (int)(compiler->p - compiler->text), compiler->text,
+            (int)(compiler->p - compiler->text), "");
+    exit(1);
+}
+
+static void skip_spaces(PredicateCompiler *compiler) {
+    while (isspace((unsigned char)*compiler->p)) {
+        compiler->p++;
+    }
+}
+
+/* Consume token if it comes next */
+static int accept(PredicateCompiler *compiler, const char *token) {
+    skip_spaces(compiler);
+    size_t len = strlen(token);
+    if (strncmp(compiler->p, token, len) == 0) {
+        compiler->p += len;
+        return 1;
+    }
+    return 0;
+}
+
+/* Append an instruction, tracking the evaluation stack depth */
+static void emit(PredicateCompiler *compiler, PredicateOp op, int arg) {
+    Predicate *predicate = compiler->predicate;
+    if (predicate->length == predicate->capacity) {
+        predicate->capacity = predicate->capacity ? predicate->capacity * 2 : 16;
+        predicate->code = (PredicateInsn*)mem_realloc(MEM_SCHEMA, predicate->code, predicate->capacity * sizeof(PredicateInsn));
+        if (!predicate->code) {
+            fprintf(stderr, "Memory allocation failed for predicate\n");
+            exit(1);
+        }
+    }
+    predicate->code[predicate->length].op = op;
+    predicate->code[predicate->length].arg = arg;
+    predicate->length++;
+
+    /* Operands push one entry, NOT keeps one, everything else pops two
+     * and pushes one */
+    if (op == PRED_FIELD || op == PRED_CONST) {
+        predicate->depth++;
+    } else if (op != PRED_NOT) {
+        predicate->depth--;
+    }
+    if (predicate->depth > PREDICATE_MAX_STACK) {
+        predicate_error(compiler, "expression too deeply nested");
+    }
+}
+
+static int is_name_char(char c) {
+    return isalnum((unsigned char)c) || c == '_';
+}
+
+/* Counted copy of length bytes of name; NULL if out of memory */
+static char* copy_name(const char *name, size_t length) {
+    char *copy = (char*)mem_alloc(MEM_SCHEMA, length + 1);
+    if (copy) {
+        memcpy(copy, name, length);
+        copy[length] = '\0';
+    }
+    return copy;
+}
+
+/* Read an identifier or a `quoted` member name */
+static char* parse_name(PredicateCompiler *compiler) {
+    const char *start = compiler->p;
+    const char *end;
+    if (*start == '`') {
+        end = strchr(start + 1, '`');
+        if (!end) {
+            predicate_error(compiler, "unterminated `name`");
+        }
+        compiler->p = end + 1;
+        start++;
+    } else {
+        end = start;
+        while (is_name_char(*end)) {
+            end++;
+        }
+        if (end == start) {
+            predicate_error(compiler, "expected a member name or literal");
+        }
+        compiler->p = end;
+    }
+
+    char *name = copy_name(start, end - start);
+    if (!name) {
+        fprintf(stderr, "Memory allocation failed for predicate\n");
+        exit(1);
+    }
+    return name;
+}
+
+/* Operand: a literal or a member path */
+static void parse_operand(PredicateCompiler *compiler) {
+    Predicate *predicate = compiler->predicate;
+    skip_spaces(compiler);
+    const char *p = compiler->p;
+    JsonValue *constant = NULL;
+
+    if (*p == '"') {
+        const char *close;
+        const char *error;
+        char *str = json_decode_string(p + 1, p + strlen(p), &close, &error);
+        if (!str) {
+            compiler->p = close;
+            predicate_error(compiler, error);
+        }
+        compiler->p = close + 1;
+        constant = create_string_owned(str, 0, 0);
+    } else if (*p == '-' || isdigit((unsigned char)*p)) {
+        char *end;
+        double number = strtod(p, &end);
+        if (end == p) {
+            predicate_error(compiler, "invalid number");
+        }
+        compiler->p = end;
+        constant = create_number(number, 0, 0);
+    } else if (strncmp(p, "true", 4) == 0 && !is_name_char(p[4])) {
+        compiler->p += 4;
+        constant = create_boolean(1, 0, 0);
+    } else if (strncmp(p, "false", 5) == 0 && !is_name_char(p[5])) {
+        compiler->p += 5;
+        constant = create_boolean(0, 0, 0);
+    } else if (strncmp(p, "null", 4) == 0 && !is_name_char(p[4])) {
+        compiler->p += 4;
+        constant = create_null(0, 0);
+    }
+
+    if (constant) {
+        predicate->constants = (JsonValue**)mem_realloc(MEM_SCHEMA, predicate->constants,
+                                                    (predicate->constant_count + 1) * sizeof(JsonValue*));
+        if (!predicate->constants) {
+            fprintf(stderr, "Memory allocation failed for predicate\n");
+            exit(1);
+        }
+        predicate->constants[predicate->constant_count] = constant;
+        emit(compiler, PRED_CONST, predicate->constant_count++);
+        return;
+    }
+
+    /* Member path: name(.name)* */
+    PredicatePath path = {NULL, 0};
+    for (;;) {
+        path.segments = (char**)mem_realloc(MEM_SCHEMA, path.segments, (path.count + 1) * sizeof(char*));
+        if (!path.segments) {
+            fprintf(stderr, "Memory allocation failed for predicate\n");
+            exit(1);
+        }
+        path.segments[path.count++] = parse_name(compiler);
+        if (*compiler->p != '.') {
+            break;
+        }
+        compiler->p++;
+    }
+
+    predicate->paths = (PredicatePath*)mem_realloc(MEM_SCHEMA, predicate->paths, (predicate->path_count + 1) * sizeof(PredicatePath));
+    if (!predicate->paths) {
+        fprintf(stderr, "Memory allocation failed for predicate\n");
+        exit(1);
+    }
+    predicate->paths[predicate->path_count] = path;
+    emit(compiler, PRED_FIELD, predicate->path_count++);
+}
+
+static void parse_or(PredicateCompiler *compiler);
+
+/* Each '(' and '!' recurses into the parser; bound it so a hostile
+ * expression fails with a message instead of overflowing the C stack */
+static void enter_nesting(PredicateCompiler *compiler) {
+    if (++compiler->nesting > PREDICATE_MAX_NESTING) {
+        predicate_error(compiler, "expression too deeply nested");
+    }
+}
+
+/* primary := '(' or ')' | operand cmp operand */
+static void parse_primary(PredicateCompiler *compiler) {
+    if (accept(compiler, "(")) {
+        enter_nesting(compiler);
+        parse_or(compiler);
+        if (!accept(compiler, ")")) {
+            predicate_error(compiler, "expected ')'");
+        }
+        compiler->nesting--;
+        return;
+    }
+
+    parse_operand(compiler);
+
+    /* Two-character operators are tried first */
+    PredicateOp op;
+    if (accept(compiler, "==")) {
+        op = PRED_EQ;
+    } else if (accept(compiler, "!=")) {
+        op = PRED_NE;
+    } else if (accept(compiler, "<=")) {
+        op = PRED_LE;
+    } else if (accept(compiler, ">=")) {
+        op = PRED_GE;
+    } else if (accept(compiler, "<")) {
+        op = PRED_LT;
+    } else if (accept(compiler, ">")) {
+        op = PRED_GT;
+    } else {
+        predicate_error(compiler, "expected a comparison operator");
+        return;
+    }
+
+    parse_operand(compiler);
+    emit(compiler, op, 0);
+}
+
+/* not := '!' not | primary */
+static void parse_not(PredicateCompiler *compiler) {
+    skip_spaces(compiler);
+    if (compiler->p[0] == '!' && compiler->p[1] != '=') {
+        compiler->p++;
+        enter_nesting(compiler);
+        parse_not(compiler);
+        compiler->nesting--;
+        emit(compiler, PRED_NOT, 0);
+        return;
+    }
+    parse_primary(compiler);
+}
+
+/* and := not ('&&' not)* */
+static void parse_and(PredicateCompiler *compiler) {
+    parse_not(compiler);
+    while (accept(compiler, "&&")) {
+        parse_not(compiler);
+        emit(compiler, PRED_AND, 0);
+    }
+}
+
+/* or := and ('||' and)* */
+static void parse_or(PredicateCompiler *compiler) {
+    parse_and(compiler);
+    while (accept(compiler, "||")) {
+        parse_and(compiler);
+        emit(compiler, PRED_OR, 0);
+    }
+}
+
+void add_predicate(Predicate **list, const char *text) {
+    Predicate *predicate = (Predicate*)mem_calloc(MEM_SCHEMA, 1, sizeof(Predicate));
+    if (!predicate) {
+        fprintf(stderr, "Memory allocation failed for predicate\n");
+        exit(1);
+    }
+    PredicateCompiler compiler = {text, text, predicate, 0};
+
+    /* Optional "TABLE:" prefix */
+    const char *q = text;
+    while (isspace((unsigned char)*q)) {
+        q++;
+    }
+    const char *name = q;
+    while (is_name_char(*q)) {
+        q++;
+    }
+    if (q > name && *q == ':') {
+        predicate->table = copy_name(name, q - name);
+        if (!predicate->table) {
+            fprintf(stderr, "Memory allocation failed for predicate\n");
+            exit(1);
+        }
+        compiler.p = q + 1;
+    }
+
+    parse_or(&compiler);
+    skip_spaces(&compiler);
+    if (*compiler.p != '\0') {
+        predicate_error(&compiler, "unexpected text after expression");
+    }
+
+    /* Append so predicates are checked in command-line order */
+    if (!*list) {
+        *list = predicate;
+    } else {
+        Predicate *last = *list;
+        while (last->next) {
+            last = last->next;
+        }
+        last->next = predicate;
+    }
+}
+
+/* Whether table has a column called name */
+static int has_column(const Table *table, const char *name) {
+    Column *col = table->columns;
+    while (col) {
+        if (strcmp(col->name, name) == 0) {
+            return 1;
+        }
+        col = col->next;
+    }
+    return 0;
+}
+
+int predicate_applies(const Predicate *predicate, const Table *table) {
+    /* TABLE: covers every shape under that key (TABLE_2, ...), or names
+     * one suffixed table on its own */
+    if (predicate->table) {
+        return strcmp(predicate->table, table->base_name) == 0 ||
+               strcmp(predicate->table, table->name) == 0;
+    }
+
+    /* Unqualified predicates cover tables with every referenced member:
+     * a value column, or the key column of a nested object for a.b */
+    for (int i = 0; i < predicate->path_count; i++) {
+        const PredicatePath *path = &predicate->paths[i];
+        if (path->count == 1) {
+            if (!has_column(table, path->segments[0])) {
+                return 0;
+            }
+        } else {
+            char fk_name[256];
+            snprintf(fk_name, sizeof(fk_name), "%s_id", path->segments[0]);
+            if (!has_column(table, fk_name)) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+/* Member of object at path, or NULL if any step is missing */
+static JsonValue* lookup_path(JsonValue *object, const PredicatePath *path) {
+    JsonValue *value = object;
+    for (int i = 0; i < path->count; i++) {
+        if (!value || value->type != JSON_OBJECT) {
+            return NULL;
+        }
+        KeyValuePair *pair = value->value.object_head;
+        value = NULL;
+        while (pair) {
+            if (strcmp(pair->key, path->segments[i]) == 0) {
+                value = &pair->value;
+                break;
+            }
+            pair = pair->next;
+        }
+    }
+    return value;
+}
+
+/* Compare two operands: <0, 0 or >0, or 2 when they are not comparable */
+static int compare_values(JsonValue *a, JsonValue *b) {
+    JsonType ta = a ? a->type : JSON_NULL;
+    JsonType tb = b ? b->type : JSON_NULL;
+    if (ta != tb) {
+        return 2;
+    }
+    switch (ta) {
+        case JSON_NUMBER:
+            if (a->value.number_value < b->value.number_value) {
+                return -1;
+            }
+            if (a->value.number_value > b->value.number_value) {
+                return 1;
+            }
+            return a->value.number_value == b->value.number_value ? 0 : 2;  /* NaN */
+        case JSON_STRING: {
+            int cmp = strcmp(json_string_text(a), json_string_text(b));
+            return cmp < 0 ? -1 : cmp > 0;
+        }
+        case JSON_BOOLEAN:
+            return (a->value.boolean_value != 0) - (b->value.boolean_value != 0);
+        case JSON_NULL:
+            return 0;
+        default:
+            return 2;  /* Containers only compare by identity */
+    }
+}
+
+/* Evaluation stack entry: an operand, or the result of a test */
+typedef struct PredicateSlot {
+    JsonValue *value;
+    int truth;
+} PredicateSlot;
+
+int evaluate_predicate(const Predicate *predicate, JsonValue *object) {
+    PredicateSlot stack[PREDICATE_MAX_STACK];
+    int top = 0;
+
+    for (int i = 0; i < predicate->length; i++) {
+        const PredicateInsn *insn = &predicate->code[i];
+        switch (insn->op) {
+            case PRED_FIELD:
+                stack[top++].value = lookup_path(object, &predicate->paths[insn->arg]);
+                break;
+            case PRED_CONST:
+                stack[top++].value = predicate->constants[insn->arg];
+                break;
+            case PRED_NOT:
+                stack[top - 1].truth = !stack[top - 1].truth;
+                break;
+            case PRED_AND:
+                top--;
+                stack[top - 1].truth = stack[top - 1].truth && stack[top].truth;
+                break;
+            case PRED_OR:
+                top--;
+                stack[top - 1].truth = stack[top - 1].truth || stack[top].truth;
+                break;
+            default: {
+                top--;
+                int cmp = compare_values(stack[top - 1].value, stack[top].value);
+                int truth;
+                switch (insn->op) {
+                    case PRED_EQ: truth = cmp == 0; break;
+                    case PRED_NE: truth = cmp != 0; break;
+                    case PRED_LT: truth = cmp == -1; break;
+                    case PRED_LE: truth = cmp == -1 || cmp == 0; break;
+                    case PRED_GT: truth = cmp == 1; break;
+                    default:      truth = cmp == 1 || cmp == 0; break;
+                }
+                stack[top - 1].truth = truth;
+                break;
+            }
+        }
+    }
+    return stack[0].truth;
+}
+
+void free_predicates(Predicate *list) {
+    while (list) {
+        Predicate *next = list->next;
+        for (int i = 0; i < list->path_count; i++) {
+            for (int j = 0; j < list->paths[i].count; j++) {
+                mem_free(MEM_SCHEMA, list->paths[i].segments[j]);
+            }
+            mem_free(MEM_SCHEMA, list->paths[i].segments);
+        }
+        for (int i = 0; i < list->constant_count; i++) {
+            free_json_value(list->constants[i]);
+        }
+        mem_free(MEM_SCHEMA, list->paths);
+        mem_free(MEM_SCHEMA, list->constants);
+        mem_free(MEM_SCHEMA, list->code);
+        mem_free(MEM_SCHEMA, list->table);
+        mem_free(MEM_SCHEMA, list);
+        list = next;
+    }
+}
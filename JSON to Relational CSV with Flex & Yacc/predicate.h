@@ -0,0 +1,75 @@
+#ifndef PREDICATE_H
+#define PREDICATE_H
+
+#include "ast.h"
+#include "schema.h"
+
+/* Row filters for --where.
+ *
+ * An expression such as  status == "active" && (age >= 18 || vip == true)
+ * is compiled once into a postfix program and then run against each
+ * object during extraction. Operands are member paths (name, a.b, or
+ * `quoted name`) and JSON literals; a missing member reads as null.
+ * Comparisons between different types are false, except != which is
+ * true. An object that fails is dropped together with everything
+ * nested under it. */
+
+/* Instructions of a compiled predicate */
+typedef enum {
+    PRED_FIELD,   /* Push the member at paths[arg] */
+    PRED_CONST,   /* Push constants[arg] */
+    PRED_EQ,
+    PRED_NE,
+    PRED_LT,
+    PRED_LE,
+    PRED_GT,
+    PRED_GE,
+    PRED_AND,
+    PRED_OR,
+    PRED_NOT
+} PredicateOp;
+
+/* Deepest evaluation stack a predicate may need */
+#define PREDICATE_MAX_STACK 64
+
+/* Deepest run of '(' and '!' the compiler accepts */
+#define PREDICATE_MAX_NESTING 256
+
+typedef struct PredicateInsn {
+    PredicateOp op;
+    int arg;
+} PredicateInsn;
+
+/* A member path split at dots */
+typedef struct PredicatePath {
+    char **segments;
+    int count;
+} PredicatePath;
+
+typedef struct Predicate {
+    char *table;               /* Only objects of this table, or NULL for
+                                  every table having the referenced members */
+    PredicateInsn *code;
+    int length;
+    int capacity;
+    int depth;                 /* Stack depth at the end of the code so far */
+    PredicatePath *paths;
+    int path_count;
+    JsonValue **constants;     /* Literal operands */
+    int constant_count;
+    struct Predicate *next;    /* Further --where options; all must pass */
+} Predicate;
+
+/* Compile "[TABLE:]EXPR" and append it to *list. Exits with a message
+ * pointing at the offending position on a syntax error. */
+void add_predicate(Predicate **list, const char *text);
+
+/* Whether a predicate is evaluated for rows of table */
+int predicate_applies(const Predicate *predicate, const Table *table);
+
+/* Run a predicate against an object */
+int evaluate_predicate(const Predicate *predicate, JsonValue *object);
+
+void free_predicates(Predicate *list);
+
+#endif /* PREDICATE_H */
@@ -1,33 +1,44 @@
 #include "schema.h"
+#include "number_format.h"
+#include "mem.h"
 #include <ctype.h>
+#include <errno.h>
+#include <pthread.h>
+
+/* Top-level array elements per inference thread, at least */
+#define SCHEMA_CHUNK_MIN 4096
 
 /* Forward declarations */
 void process_object(SchemaContext *context, JsonValue *object, Table *parent_table, const char *parent_key, int array_index);
 void process_array(SchemaContext *context, JsonValue *array, Table *parent_table, const char *array_key);
 
 /* Create a new schema context */
-SchemaContext* create_schema_context(const char *output_dir, int print_ast) {
-    SchemaContext *context = (SchemaContext*)malloc(sizeof(SchemaContext));
+SchemaContext* create_schema_context(const char *output_dir) {
+    SchemaContext *context = (SchemaContext*)mem_alloc(MEM_SCHEMA, sizeof(SchemaContext));
     if (!context) {
         fprintf(stderr, "Memory allocation failed for schema context\n");
         exit(1);
     }
     
     context->tables = NULL;
-    context->print_ast = print_ast;
+    context->unify = 0;
+    context->next_id = 0;
+    context->id_strategy = ID_DENSE;
+    context->id_strategy_loaded = 0;
+    context->jobs = 1;
     
     if (output_dir) {
-        context->output_dir = strdup(output_dir);
+        context->output_dir = mem_strdup(MEM_SCHEMA, output_dir);
         if (!context->output_dir) {
             fprintf(stderr, "Memory allocation failed for output directory\n");
-            free(context);
+            mem_free(MEM_SCHEMA, context);
             exit(1);
         }
     } else {
-        context->output_dir = strdup(".");  /* Default to current directory */
+        context->output_dir = mem_strdup(MEM_SCHEMA, ".");  /* Default to current directory */
         if (!context->output_dir) {
             fprintf(stderr, "Memory allocation failed for output directory\n");
-            free(context);
+            mem_free(MEM_SCHEMA, context);
             exit(1);
         }
     }
@@ -49,7 +60,7 @@ char* generate_object_signature(JsonValue *object) {
         pair = pair->next;
     }
     
-    char *signature = (char*)malloc(sig_len);
+    char *signature = (char*)mem_alloc(MEM_SCHEMA, sig_len);
     if (!signature) {
         fprintf(stderr, "Memory allocation failed for object signature\n");
         exit(1);
@@ -69,40 +80,159 @@ char* generate_object_signature(JsonValue *object) {
     return signature;
 }
 
-/* Find or create a table by name and signature */
-Table* find_or_create_table(SchemaContext *context, const char *name, const char *object_signature) {
-    /* First, look for an existing table with the same signature */
+/* Check whether a signature's key list contains a key */
+static int signature_has_key(const char *signature, const char *key, size_t key_len) {
+    const char *p = signature;
+    while (*p) {
+        const char *end = strchr(p, ',');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        if (len == key_len && strncmp(p, key, len) == 0) {
+            return 1;
+        }
+        if (!end) {
+            break;
+        }
+        p = end + 1;
+    }
+    return 0;
+}
+
+/* Check whether two object signatures share at least one key */
+static int signatures_overlap(const char *a, const char *b) {
+    const char *p = a;
+    while (*p) {
+        const char *end = strchr(p, ',');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        if (signature_has_key(b, p, len)) {
+            return 1;
+        }
+        if (!end) {
+            break;
+        }
+        p = end + 1;
+    }
+    return 0;
+}
+
+/* Find a table with the same name whose shapes overlap with a signature */
+static Table* find_unifiable_table(SchemaContext *context, const char *name, const char *object_signature) {
+    if (strncmp(object_signature, "junction:", 9) == 0) {
+        return NULL;
+    }
+
     Table *table = context->tables;
     while (table) {
-        if (table->object_signature && strcmp(table->object_signature, object_signature) == 0) {
+        if (strcmp(table->name, name) == 0 &&
+            strncmp(table->object_signature, "junction:", 9) != 0) {
+            /* Empty objects fit any shape */
+            if (object_signature[0] == '\0' || table->object_signature[0] == '\0' ||
+                signatures_overlap(object_signature, table->object_signature)) {
+                return table;
+            }
+
+            SignatureAlias *alias = table->aliases;
+            while (alias) {
+                if (signatures_overlap(object_signature, alias->signature)) {
+                    return table;
+                }
+                alias = alias->next;
+            }
+        }
+        table = table->next;
+    }
+    return NULL;
+}
+
+/* Find a table by its name */
+static Table* find_table_by_name(SchemaContext *context, const char *name) {
+    Table *table = context->tables;
+    while (table) {
+        if (strcmp(table->name, name) == 0) {
             return table;
         }
         table = table->next;
     }
+    return NULL;
+}
+
+/* Record an additional shape that maps to an existing table */
+void add_signature_alias(Table *table, const char *signature) {
+    SignatureAlias *alias = (SignatureAlias*)mem_alloc(MEM_SCHEMA, sizeof(SignatureAlias));
+    if (!alias) {
+        fprintf(stderr, "Memory allocation failed for signature alias\n");
+        exit(1);
+    }
+
+    alias->signature = mem_strdup(MEM_SCHEMA, signature);
+    if (!alias->signature) {
+        fprintf(stderr, "Memory allocation failed for signature alias\n");
+        mem_free(MEM_SCHEMA, alias);
+        exit(1);
+    }
+
+    alias->next = table->aliases;
+    table->aliases = alias;
+}
+
+/* Find or create a table by name and signature */
+Table* find_or_create_table(SchemaContext *context, const char *name, const char *object_signature) {
+    /* First, look for an existing table with the same signature */
+    Table *table = find_table_by_signature(context, object_signature);
+    if (table) {
+        return table;
+    }
+
+    /* In unify mode, merge compatible shapes under the same key */
+    if (context->unify) {
+        table = find_unifiable_table(context, name, object_signature);
+        if (table) {
+            add_signature_alias(table, object_signature);
+            return table;
+        }
+    }
+
+    /* Other shapes keep their own table under a distinct file name, so
+     * two tables never write (or truncate) the same CSV file */
+    const char *base_name = name;
+    char unique_name[256];
+    if (find_table_by_name(context, name)) {
+        int suffix = 1;
+        snprintf(unique_name, sizeof(unique_name), "%s", name);
+        while (find_table_by_name(context, unique_name)) {
+            snprintf(unique_name, sizeof(unique_name), "%s_%d", name, ++suffix);
+        }
+        name = unique_name;
+    }
     
     /* Create a new table */
-    table = (Table*)malloc(sizeof(Table));
+    table = (Table*)mem_alloc(MEM_SCHEMA, sizeof(Table));
     if (!table) {
         fprintf(stderr, "Memory allocation failed for table\n");
         exit(1);
     }
     
-    table->name = strdup(name);
-    if (!table->name) {
+    table->name = mem_strdup(MEM_SCHEMA, name);
+    table->base_name = mem_strdup(MEM_SCHEMA, base_name);
+    if (!table->name || !table->base_name) {
         fprintf(stderr, "Memory allocation failed for table name\n");
-        free(table);
+        mem_free(MEM_SCHEMA, table);
         exit(1);
     }
     
     table->columns = NULL;
     table->next = NULL;
     table->parent_table = NULL;
+    table->aliases = NULL;
+    table->stored = 0;
+    table->segments = 1;
+    table->next_id = 0;
     
-    table->object_signature = strdup(object_signature);
+    table->object_signature = mem_strdup(MEM_SCHEMA, object_signature);
     if (!table->object_signature) {
         fprintf(stderr, "Memory allocation failed for object signature\n");
-        free(table->name);
-        free(table);
+        mem_free(MEM_SCHEMA, table->name);
+        mem_free(MEM_SCHEMA, table->base_name);
+        mem_free(MEM_SCHEMA, table);
         exit(1);
     }
     
@@ -123,34 +253,80 @@ Table* find_or_create_table(SchemaContext *context, const char *name, const char
     return table;
 }
 
-/* Add a column to a table */
+/* Position of a value column type in the widening lattice, -1 for key columns */
+static int column_type_rank(ColumnType type) {
+    switch (type) {
+        case COL_NULL:    return 0;
+        case COL_BOOLEAN: return 1;
+        case COL_INTEGER: return 2;
+        case COL_NUMBER:  return 3;
+        case COL_STRING:  return 4;
+        default:          return -1;
+    }
+}
+
+/* Least column type that holds both the current type and a newly seen one */
+ColumnType widen_column_type(ColumnType current, ColumnType seen) {
+    int current_rank = column_type_rank(current);
+    int seen_rank = column_type_rank(seen);
+
+    /* Key columns never change type */
+    if (current_rank < 0 || seen_rank < 0) {
+        return current;
+    }
+    return seen_rank > current_rank ? seen : current;
+}
+
+/* Tightest column type for a scalar JSON value */
+ColumnType column_type_for_value(JsonValue *value) {
+    switch (value->type) {
+        case JSON_STRING:
+            return COL_STRING;
+
+        case JSON_NUMBER:
+            /* Integral and exactly representable as a double */
+            return number_is_exact_integer(value->value.number_value) ? COL_INTEGER : COL_NUMBER;
+
+        case JSON_BOOLEAN:
+            return COL_BOOLEAN;
+
+        default:
+            return COL_NULL;
+    }
+}
+
+/* Add a column to a table, widening its type if it already exists */
 void add_column(Table *table, const char *name, ColumnType type) {
     /* Check if the column already exists */
     Column *col = table->columns;
     while (col) {
         if (strcmp(col->name, name) == 0) {
+            col->type = widen_column_type(col->type, type);
             return;  /* Column already exists */
         }
         col = col->next;
     }
     
     /* Create a new column */
-    Column *new_col = (Column*)malloc(sizeof(Column));
+    Column *new_col = (Column*)mem_alloc(MEM_SCHEMA, sizeof(Column));
     if (!new_col) {
         fprintf(stderr, "Memory allocation failed for column\n");
         exit(1);
     }
     
-    new_col->name = strdup(name);
+    new_col->name = mem_strdup(MEM_SCHEMA, name);
     if (!new_col->name) {
         fprintf(stderr, "Memory allocation failed for column name\n");
-        free(new_col);
+        mem_free(MEM_SCHEMA, new_col);
         exit(1);
     }
     
     new_col->type = type;
     new_col->next = NULL;
     
+    /* Columns new to a stored table go to a fresh sidecar file */
+    new_col->segment = table->stored ? table->segments : 0;
+    
     /* Add to the end of the column list */
     if (table->columns == NULL) {
         table->columns = new_col;
@@ -170,6 +346,16 @@ Table* find_table_by_signature(SchemaContext *context, const char *signature) {
         if (table->object_signature && strcmp(table->object_signature, signature) == 0) {
             return table;
         }
+
+        /* Shapes unified into this table */
+        SignatureAlias *alias = table->aliases;
+        while (alias) {
+            if (strcmp(alias->signature, signature) == 0) {
+                return table;
+            }
+            alias = alias->next;
+        }
+
         table = table->next;
     }
     return NULL;
@@ -178,7 +364,7 @@ Table* find_table_by_signature(SchemaContext *context, const char *signature) {
 /* Create a table name from an object key */
 char* create_table_name(const char *key) {
     /* Convert key to lowercase and remove non-alphanumeric chars */
-    char *name = strdup(key);
+    char *name = mem_strdup(MEM_SCHEMA, key);
     if (!name) {
         fprintf(stderr, "Memory allocation failed for table name\n");
         exit(1);
@@ -187,23 +373,93 @@ char* create_table_name(const char *key) {
     /* Make it plural if it's not already */
     int len = strlen(name);
     if (len > 0 && name[len-1] != 's') {
-        char *plural = (char*)malloc(len + 2);
+        char *plural = (char*)mem_alloc(MEM_SCHEMA, len + 2);
         if (!plural) {
             fprintf(stderr, "Memory allocation failed for plural table name\n");
-            free(name);
+            mem_free(MEM_SCHEMA, name);
             exit(1);
         }
         strcpy(plural, name);
         strcat(plural, "s");
-        free(name);
+        mem_free(MEM_SCHEMA, name);
         return plural;
     }
     
     return name;
 }
 
-/* Process an object and add its fields to the schema */
-void process_object(SchemaContext *context, JsonValue *object, Table *parent_table, const char *parent_key, int array_index) {
+/* An object, or an array of objects, whose members are still being visited.
+ * Schema detection walks the AST with an explicit stack of these frames so
+ * arbitrarily deep documents cannot overflow the C stack. */
+typedef struct SchemaFrame {
+    JsonType type;         /* JSON_OBJECT or JSON_ARRAY */
+    Table *table;          /* Object: its table; array: the parent table */
+    const char *key;       /* Array: the key it was found under */
+    KeyValuePair *pair;    /* Object: next pair to visit */
+    ArrayElement *elem;    /* Array: next element to visit */
+    int index;             /* Array: index of the next element */
+    Table *fk_table;       /* Object: parent that gets a <fk_key>_id column once done */
+    const char *fk_key;
+} SchemaFrame;
+
+/* Explicit traversal stack */
+typedef struct SchemaWalk {
+    SchemaFrame *frames;
+    int depth;
+    int capacity;
+} SchemaWalk;
+
+/* Push a zeroed frame and return it */
+static SchemaFrame* push_schema_frame(SchemaWalk *walk, JsonType type) {
+    if (walk->depth == walk->capacity) {
+        walk->capacity = walk->capacity ? walk->capacity * 2 : 32;
+        walk->frames = (SchemaFrame*)mem_realloc(MEM_SCHEMA, walk->frames, walk->capacity * sizeof(SchemaFrame));
+        if (!walk->frames) {
+            fprintf(stderr, "Memory allocation failed for schema traversal stack\n");
+            exit(1);
+        }
+    }
+
+    SchemaFrame *frame = &walk->frames[walk->depth++];
+    memset(frame, 0, sizeof(*frame));
+    frame->type = type;
+    return frame;
+}
+
+/* Create the junction table for an array of scalars and type its value column */
+static void process_scalar_array(SchemaContext *context, JsonValue *array, Table *parent_table, const char *array_key) {
+    char table_name[256];
+    sprintf(table_name, "%s", array_key);
+    
+    /* Create the junction table */
+    char signature[256];
+    sprintf(signature, "junction:%s", array_key);
+    Table *junction = find_or_create_table(context, table_name, signature);
+    
+    /* Set parent table and add columns */
+    if (!junction->parent_table) {
+        junction->parent_table = mem_strdup(MEM_SCHEMA, parent_table->name);
+        
+        char fk_name[256];
+        sprintf(fk_name, "%s_id", parent_table->name);
+        add_column(junction, fk_name, COL_FOREIGN_KEY);
+        add_column(junction, "index", COL_INDEX);
+        add_column(junction, "value", COL_NULL);
+    }
+    
+    /* Widen the value column to hold every scalar in the array */
+    ColumnType value_type = COL_NULL;
+    ArrayElement *elem = array->value.array_head;
+    while (elem) {
+        value_type = widen_column_type(value_type, column_type_for_value(&elem->value));
+        elem = elem->next;
+    }
+    add_column(junction, "value", value_type);
+}
+
+/* Register an object's table and queue its members for visiting */
+static void enter_object(SchemaContext *context, SchemaWalk *walk, JsonValue *object, Table *parent_table,
+                         const char *parent_key, int array_index, Table *fk_table, const char *fk_key) {
     if (object->type != JSON_OBJECT) {
         return;
     }
@@ -217,17 +473,18 @@ void process_object(SchemaContext *context, JsonValue *object, Table *parent_tab
         table_name = create_table_name(parent_key);
     } else {
         /* Root object - use default name */
-        table_name = strdup("root");
+        table_name = mem_strdup(MEM_SCHEMA, "root");
     }
     
     /* Find or create the table */
     Table *table = find_or_create_table(context, table_name, signature);
-    free(table_name);
+    mem_free(MEM_SCHEMA, table_name);
+    mem_free(MEM_SCHEMA, signature);
     
     /* If this is a nested object in an array, set the parent table */
     if (parent_table && array_index >= 0) {
         if (!table->parent_table) {
-            table->parent_table = strdup(parent_table->name);
+            table->parent_table = mem_strdup(MEM_SCHEMA, parent_table->name);
             
             /* Add foreign key column */
             char fk_name[256];
@@ -235,56 +492,20 @@ void process_object(SchemaContext *context, JsonValue *object, Table *parent_tab
             add_column(table, fk_name, COL_FOREIGN_KEY);
             
             /* Add index column if this is an array element */
-            if (array_index >= 0) {
-                add_column(table, "seq", COL_INDEX);
-            }
-        }
-    }
-    
-    /* Process all key-value pairs */
-    KeyValuePair *pair = object->value.object_head;
-    while (pair) {
-        switch (pair->value->type) {
-            case JSON_OBJECT:
-                /* Recursive call for nested objects */
-                process_object(context, pair->value, table, pair->key, -1);
-                
-                /* Add a column for the foreign key to the nested object */
-                char fk_name[256];
-                sprintf(fk_name, "%s_id", pair->key);
-                add_column(table, fk_name, COL_FOREIGN_KEY);
-                break;
-                
-            case JSON_ARRAY:
-                /* Process arrays */
-                process_array(context, pair->value, table, pair->key);
-                break;
-                
-            case JSON_STRING:
-                add_column(table, pair->key, COL_STRING);
-                break;
-                
-            case JSON_NUMBER:
-                add_column(table, pair->key, COL_NUMBER);
-                break;
-                
-            case JSON_BOOLEAN:
-                add_column(table, pair->key, COL_BOOLEAN);
-                break;
-                
-            case JSON_NULL:
-                add_column(table, pair->key, COL_NULL);
-                break;
+            add_column(table, "seq", COL_INDEX);
         }
-        
-        pair = pair->next;
     }
     
-    free(signature);
+    /* Visit the key-value pairs from the traversal loop */
+    SchemaFrame *frame = push_schema_frame(walk, JSON_OBJECT);
+    frame->table = table;
+    frame->pair = object->value.object_head;
+    frame->fk_table = fk_table;
+    frame->fk_key = fk_key;
 }
 
-/* Process an array and create appropriate tables */
-void process_array(SchemaContext *context, JsonValue *array, Table *parent_table, const char *array_key) {
+/* Handle an array found under a key of an object in parent_table */
+static void enter_array(SchemaContext *context, SchemaWalk *walk, JsonValue *array, Table *parent_table, const char *array_key) {
     if (array->type != JSON_ARRAY) {
         return;
     }
@@ -295,45 +516,537 @@ void process_array(SchemaContext *context, JsonValue *array, Table *parent_table
         return;  /* Empty array */
     }
     
-    if (elem->value->type == JSON_OBJECT) {
-        /* Array of objects - create a child table */
-        int index = 0;
-        while (elem) {
-            process_object(context, elem->value, parent_table, array_key, index++);
-            elem = elem->next;
-        }
+    if (elem->value.type == JSON_OBJECT) {
+        /* Array of objects - visit each element into a child table */
+        SchemaFrame *frame = push_schema_frame(walk, JSON_ARRAY);
+        frame->table = parent_table;
+        frame->key = array_key;
+        frame->elem = elem;
     } else {
         /* Array of scalars - create a junction table */
-        char table_name[256];
-        sprintf(table_name, "%s", array_key);
-        
-        /* Create the junction table */
-        char signature[256];
-        sprintf(signature, "junction:%s", array_key);
-        Table *junction = find_or_create_table(context, table_name, signature);
+        process_scalar_array(context, array, parent_table, array_key);
+    }
+}
+
+/* Visit queued members until the stack is empty.
+ * Tables and columns are created in the same order as a depth-first recursion. */
+static void run_schema_walk(SchemaContext *context, SchemaWalk *walk) {
+    while (walk->depth > 0) {
+        SchemaFrame *top = &walk->frames[walk->depth - 1];
         
-        /* Set parent table and add columns */
-        if (!junction->parent_table) {
-            junction->parent_table = strdup(parent_table->name);
+        if (top->type == JSON_OBJECT) {
+            KeyValuePair *pair = top->pair;
+            if (!pair) {
+                /* Object finished: its parent now gets the foreign key column */
+                Table *fk_table = top->fk_table;
+                const char *fk_key = top->fk_key;
+                walk->depth--;
+                
+                if (fk_table) {
+                    char fk_name[256];
+                    sprintf(fk_name, "%s_id", fk_key);
+                    add_column(fk_table, fk_name, COL_FOREIGN_KEY);
+                }
+                continue;
+            }
+            top->pair = pair->next;
             
-            char fk_name[256];
-            sprintf(fk_name, "%s_id", parent_table->name);
-            add_column(junction, fk_name, COL_FOREIGN_KEY);
-            add_column(junction, "index", COL_INDEX);
-            add_column(junction, "value", COL_STRING);  /* Using string for all scalar values */
+            Table *table = top->table;
+            switch (pair->value.type) {
+                case JSON_OBJECT:
+                    /* Nested object; the foreign key column is added when it completes */
+                    enter_object(context, walk, &pair->value, table, pair->key, -1, table, pair->key);
+                    break;
+                    
+                case JSON_ARRAY:
+                    enter_array(context, walk, &pair->value, table, pair->key);
+                    break;
+                    
+                case JSON_STRING:
+                case JSON_NUMBER:
+                case JSON_BOOLEAN:
+                case JSON_NULL:
+                    add_column(table, pair->key, column_type_for_value(&pair->value));
+                    break;
+            }
+        } else {
+            ArrayElement *elem = top->elem;
+            if (!elem) {
+                walk->depth--;
+                continue;
+            }
+            top->elem = elem->next;
+            
+            int index = top->index++;
+            enter_object(context, walk, &elem->value, top->table, top->key, index, NULL, NULL);
+        }
+    }
+    
+    mem_free(MEM_SCHEMA, walk->frames);
+    walk->frames = NULL;
+    walk->capacity = 0;
+}
+
+/* Process an object and add its fields to the schema */
+void process_object(SchemaContext *context, JsonValue *object, Table *parent_table, const char *parent_key, int array_index) {
+    SchemaWalk walk = {NULL, 0, 0};
+    enter_object(context, &walk, object, parent_table, parent_key, array_index, NULL, NULL);
+    run_schema_walk(context, &walk);
+}
+
+/* Process an array and create appropriate tables */
+void process_array(SchemaContext *context, JsonValue *array, Table *parent_table, const char *array_key) {
+    SchemaWalk walk = {NULL, 0, 0};
+    enter_array(context, &walk, array, parent_table, array_key);
+    run_schema_walk(context, &walk);
+}
+
+/* Part of a top-level array inferred on its own thread */
+typedef struct SchemaChunk {
+    SchemaContext *context;  /* Tables and columns seen in this part only */
+    ArrayElement *first;
+    size_t count;
+    pthread_t thread;
+} SchemaChunk;
+
+/* Visit the records of one part of a top-level array */
+static void* infer_schema_chunk(void *arg) {
+    SchemaChunk *chunk = (SchemaChunk*)arg;
+    ArrayElement *elem = chunk->first;
+    for (size_t i = 0; i < chunk->count; i++) {
+        process_object(chunk->context, &elem->value, NULL, NULL, -1);
+        elem = elem->next;
+    }
+    return NULL;
+}
+
+/* Add the tables of a later part's schema to context, as if its records
+ * had been visited there. Tables are matched by signature and replayed in
+ * creation order, so names, suffixes and column order come out as in a
+ * serial pass; column types widen the same way in any order. Parent names
+ * and the foreign keys derived from them are translated to the merged
+ * tables' names. */
+static void merge_schema(SchemaContext *context, SchemaContext *part) {
+    int count = 0;
+    Table *table = part->tables;
+    while (table) {
+        count++;
+        table = table->next;
+    }
+
+    /* Merged table of each table of the part, in the same order */
+    Table **merged = (Table**)mem_alloc(MEM_SCHEMA, (count ? count : 1) * sizeof(Table*));
+    if (!merged) {
+        fprintf(stderr, "Memory allocation failed for schema merge\n");
+        exit(1);
+    }
+
+    int index = 0;
+    table = part->tables;
+    while (table) {
+        Table *target = find_or_create_table(context, table->base_name, table->object_signature);
+        merged[index] = target;
+
+        /* A parent always comes first: its object encloses the child */
+        char part_fk[256] = "";
+        char target_fk[256] = "";
+        if (table->parent_table) {
+            if (!target->parent_table) {
+                const char *parent_name = table->parent_table;
+                Table *parent = part->tables;
+                for (int i = 0; i < index; i++, parent = parent->next) {
+                    if (strcmp(parent->name, table->parent_table) == 0) {
+                        parent_name = merged[i]->name;
+                        break;
+                    }
+                }
+                target->parent_table = mem_strdup(MEM_SCHEMA, parent_name);
+                if (!target->parent_table) {
+                    fprintf(stderr, "Memory allocation failed for parent table name\n");
+                    exit(1);
+                }
+            }
+            snprintf(part_fk, sizeof(part_fk), "%s_id", table->parent_table);
+            snprintf(target_fk, sizeof(target_fk), "%s_id", target->parent_table);
         }
+
+        Column *col = table->columns;
+        while (col) {
+            if (col->type == COL_FOREIGN_KEY && strcmp(col->name, part_fk) == 0) {
+                add_column(target, target_fk, COL_FOREIGN_KEY);
+            } else {
+                add_column(target, col->name, col->type);
+            }
+            col = col->next;
+        }
+
+        index++;
+        table = table->next;
     }
+    mem_free(MEM_SCHEMA, merged);
+}
+
+/* Infer the records of a top-level array, splitting a large one into
+ * consecutive parts that are inferred concurrently and merged in order */
+static void detect_array_schema(SchemaContext *context, JsonValue *array) {
+    size_t count = 0;
+    ArrayElement *elem = array->value.array_head;
+    while (elem) {
+        count++;
+        elem = elem->next;
+    }
+
+    /* Unified tables depend on the order shapes are met in, so --unify
+     * stays serial */
+    size_t parts = count / SCHEMA_CHUNK_MIN;
+    if (parts > (size_t)context->jobs) {
+        parts = context->jobs;
+    }
+    if (parts <= 1 || context->unify) {
+        elem = array->value.array_head;
+        while (elem) {
+            process_object(context, &elem->value, NULL, NULL, -1);
+            elem = elem->next;
+        }
+        return;
+    }
+
+    SchemaChunk *chunks = (SchemaChunk*)mem_calloc(MEM_SCHEMA, parts, sizeof(SchemaChunk));
+    if (!chunks) {
+        fprintf(stderr, "Memory allocation failed for schema chunks\n");
+        exit(1);
+    }
+
+    /* The first part goes straight into context on this thread */
+    elem = array->value.array_head;
+    for (size_t i = 0; i < parts; i++) {
+        chunks[i].context = i == 0 ? context : create_schema_context(NULL);
+        chunks[i].first = elem;
+        chunks[i].count = count / parts + (i < count % parts ? 1 : 0);
+        for (size_t j = 0; j < chunks[i].count; j++) {
+            elem = elem->next;
+        }
+    }
+    for (size_t i = 1; i < parts; i++) {
+        int error = pthread_create(&chunks[i].thread, NULL, infer_schema_chunk, &chunks[i]);
+        if (error != 0) {
+            fprintf(stderr, "Error starting schema worker: %s\n", strerror(error));
+            exit(1);
+        }
+    }
+    infer_schema_chunk(&chunks[0]);
+
+    for (size_t i = 1; i < parts; i++) {
+        pthread_join(chunks[i].thread, NULL);
+        merge_schema(context, chunks[i].context);
+        free_schema_context(chunks[i].context);
+    }
+    mem_free(MEM_SCHEMA, chunks);
 }
 
 /* Detect schema from the AST */
 void detect_schema(SchemaContext *context, JsonValue *root) {
-    /* Print AST if requested */
-    if (context->print_ast) {
-        print_ast(root, 0);
+    if (root->type == JSON_ARRAY) {
+        /* A top-level array holds one root record per element */
+        detect_array_schema(context, root);
+    } else {
+        /* Process the root object */
+        process_object(context, root, NULL, NULL, -1);
+    }
+}
+
+/* Schema file format (one record per line, fields separated by tabs):
+ *   json2relcsv-schema 1
+ *   T <name> <signature> [<base>]
+ *                            table definition, and the name it was asked
+ *                            for when it got a _2, _3, ... suffix
+ *   P <parent>               parent table of the preceding table
+ *   A <signature>            additional shape unified into the preceding table
+ *   C <name> <type> [<seg>]  column of the preceding table, and the file
+ *                            holding it (0 main CSV, n > 0 sidecar n)
+ *   S <strategy>             ID strategy, "dense" or "per-table" (--append runs)
+ *   N <id>                   next row ID of the dense sequence
+ *   I <id>                   next row ID of the preceding table's sequence
+ * Tabs, newlines and backslashes inside fields are backslash-escaped. */
+#define SCHEMA_FILE_MAGIC "json2relcsv-schema 1"
+
+static const char *column_type_names[] = {
+    "id", "fk", "index", "string", "number", "boolean", "null", "integer"
+};
+
+/* Write a field with tabs, newlines and backslashes escaped */
+static void write_schema_field(FILE *file, const char *field) {
+    for (const char *p = field; *p; p++) {
+        switch (*p) {
+            case '\\': fputs("\\\\", file); break;
+            case '\t': fputs("\\t", file); break;
+            case '\n': fputs("\\n", file); break;
+            case '\r': fputs("\\r", file); break;
+            default:   fputc(*p, file); break;
+        }
+    }
+}
+
+/* Undo write_schema_field in place */
+static void unescape_schema_field(char *field) {
+    char *out = field;
+    for (char *p = field; *p; p++) {
+        if (*p == '\\' && p[1]) {
+            p++;
+            switch (*p) {
+                case 't': *out++ = '\t'; break;
+                case 'n': *out++ = '\n'; break;
+                case 'r': *out++ = '\r'; break;
+                default:  *out++ = *p; break;
+            }
+        } else {
+            *out++ = *p;
+        }
+    }
+    *out = '\0';
+}
+
+/* Save the inferred schema so later runs can skip detection */
+void save_schema(SchemaContext *context, const char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        fprintf(stderr, "Error opening schema file %s for writing: %s\n", path, strerror(errno));
+        exit(1);
+    }
+
+    fprintf(file, "%s\n", SCHEMA_FILE_MAGIC);
+    if (context->next_id > 0 || context->id_strategy == ID_PER_TABLE) {
+        fprintf(file, "S\t%s\n", context->id_strategy == ID_PER_TABLE ? "per-table" : "dense");
+    }
+    if (context->next_id > 0) {
+        fprintf(file, "N\t%lld\n", (long long)context->next_id);
+    }
+
+    Table *table = context->tables;
+    while (table) {
+        fputs("T\t", file);
+        write_schema_field(file, table->name);
+        fputc('\t', file);
+        write_schema_field(file, table->object_signature);
+        if (strcmp(table->base_name, table->name) != 0) {
+            fputc('\t', file);
+            write_schema_field(file, table->base_name);
+        }
+        fputc('\n', file);
+
+        if (table->next_id > 0) {
+            fprintf(file, "I\t%lld\n", (long long)table->next_id);
+        }
+
+        if (table->parent_table) {
+            fputs("P\t", file);
+            write_schema_field(file, table->parent_table);
+            fputc('\n', file);
+        }
+
+        SignatureAlias *alias = table->aliases;
+        while (alias) {
+            fputs("A\t", file);
+            write_schema_field(file, alias->signature);
+            fputc('\n', file);
+            alias = alias->next;
+        }
+
+        Column *col = table->columns;
+        while (col) {
+            fputs("C\t", file);
+            write_schema_field(file, col->name);
+            fprintf(file, "\t%s", column_type_names[col->type]);
+            if (col->segment > 0) {
+                fprintf(file, "\t%d", col->segment);
+            }
+            fputc('\n', file);
+            col = col->next;
+        }
+
+        table = table->next;
+    }
+
+    if (fclose(file) != 0) {
+        fprintf(stderr, "Error writing schema file %s: %s\n", path, strerror(errno));
+        exit(1);
+    }
+}
+
+/* Report a malformed schema file and abort */
+static void schema_file_error(const char *path, int line_no, const char *msg) {
+    fprintf(stderr, "Error: %s in schema file %s at line %d\n", msg, path, line_no);
+    exit(1);
+}
+
+/* Load a schema previously written by save_schema */
+void load_schema(SchemaContext *context, const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "Error opening schema file %s: %s\n", path, strerror(errno));
+        exit(1);
+    }
+
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    int line_no = 0;
+    Table *table = NULL;
+
+    while ((len = getline(&line, &cap, file)) != -1) {
+        line_no++;
+        if (len > 0 && line[len - 1] == '\n') {
+            line[--len] = '\0';
+        }
+
+        if (line_no == 1) {
+            if (strcmp(line, SCHEMA_FILE_MAGIC) != 0) {
+                schema_file_error(path, line_no, "Unrecognized header");
+            }
+            continue;
+        }
+        if (len == 0) {
+            continue;
+        }
+        if (len < 2 || line[1] != '\t') {
+            schema_file_error(path, line_no, "Malformed record");
+        }
+
+        /* Split the record into its tab-separated fields */
+        char *field1 = line + 2;
+        char *field2 = strchr(field1, '\t');
+        char *field3 = NULL;
+        if (field2) {
+            *field2++ = '\0';
+            field3 = strchr(field2, '\t');
+            if (field3) {
+                *field3++ = '\0';
+            }
+            unescape_schema_field(field2);
+        }
+        unescape_schema_field(field1);
+
+        switch (line[0]) {
+            case 'T':
+                if (!field2) {
+                    schema_file_error(path, line_no, "Table record without signature");
+                }
+                table = find_or_create_table(context, field1, field2);
+                if (field3) {
+                    unescape_schema_field(field3);
+                    mem_free(MEM_SCHEMA, table->base_name);
+                    table->base_name = mem_strdup(MEM_SCHEMA, field3);
+                    if (!table->base_name) {
+                        fprintf(stderr, "Memory allocation failed for table name\n");
+                        exit(1);
+                    }
+                }
+                break;
+
+            case 'P':
+                if (!table) {
+                    schema_file_error(path, line_no, "Parent record before any table");
+                }
+                mem_free(MEM_SCHEMA, table->parent_table);
+                table->parent_table = mem_strdup(MEM_SCHEMA, field1);
+                if (!table->parent_table) {
+                    fprintf(stderr, "Memory allocation failed for parent table name\n");
+                    exit(1);
+                }
+                break;
+
+            case 'A':
+                if (!table) {
+                    schema_file_error(path, line_no, "Alias record before any table");
+                }
+                add_signature_alias(table, field1);
+                break;
+
+            case 'C': {
+                if (!table || !field2) {
+                    schema_file_error(path, line_no, "Malformed column record");
+                }
+                int type = -1;
+                for (size_t i = 0; i < sizeof(column_type_names) / sizeof(column_type_names[0]); i++) {
+                    if (strcmp(field2, column_type_names[i]) == 0) {
+                        type = (int)i;
+                        break;
+                    }
+                }
+                if (type < 0) {
+                    schema_file_error(path, line_no, "Unknown column type");
+                }
+                add_column(table, field1, (ColumnType)type);
+                if (field3) {
+                    Column *col = table->columns;
+                    while (col->next) {
+                        col = col->next;
+                    }
+                    col->segment = atoi(field3);
+                    if (col->segment < 0) {
+                        schema_file_error(path, line_no, "Bad column segment");
+                    }
+                }
+                break;
+            }
+
+            case 'S':
+                if (strcmp(field1, "dense") == 0) {
+                    context->id_strategy = ID_DENSE;
+                } else if (strcmp(field1, "per-table") == 0) {
+                    context->id_strategy = ID_PER_TABLE;
+                } else {
+                    schema_file_error(path, line_no, "Unknown ID strategy");
+                }
+                context->id_strategy_loaded = 1;
+                break;
+
+            case 'N':
+                context->next_id = strtoll(field1, NULL, 10);
+                if (context->next_id <= 0) {
+                    schema_file_error(path, line_no, "Bad next ID");
+                }
+                break;
+
+            case 'I':
+                if (!table) {
+                    schema_file_error(path, line_no, "ID record before any table");
+                }
+                table->next_id = strtoll(field1, NULL, 10);
+                if (table->next_id <= 0) {
+                    schema_file_error(path, line_no, "Bad next ID");
+                }
+                break;
+
+            default:
+                schema_file_error(path, line_no, "Unknown record type");
+        }
+    }
+
+    if (line_no == 0) {
+        schema_file_error(path, 1, "Missing header");
+    }
+
+    free(line);
+    fclose(file);
+}
+
+/* Mark every table as already written, so that tables and columns found
+ * afterwards go to new files instead of rewriting the stored ones */
+void mark_schema_stored(SchemaContext *context) {
+    Table *table = context->tables;
+    while (table) {
+        table->stored = 1;
+        table->segments = 1;
+        Column *col = table->columns;
+        while (col) {
+            if (col->segment >= table->segments) {
+                table->segments = col->segment + 1;
+            }
+            col = col->next;
+        }
+        table = table->next;
     }
-    
-    /* Process the root object */
-    process_object(context, root, NULL, NULL, -1);
 }
 
 /* Free memory for a schema context */
@@ -351,21 +1064,31 @@ void free_schema_context(SchemaContext *context) {
         Column *col = table->columns;
         while (col) {
             Column *next_col = col->next;
-            free(col->name);
-            free(col);
+            mem_free(MEM_SCHEMA, col->name);
+            mem_free(MEM_SCHEMA, col);
             col = next_col;
         }
         
-        free(table->name);
-        free(table->object_signature);
+        /* Free unified shapes */
+        SignatureAlias *alias = table->aliases;
+        while (alias) {
+            SignatureAlias *next_alias = alias->next;
+            mem_free(MEM_SCHEMA, alias->signature);
+            mem_free(MEM_SCHEMA, alias);
+            alias = next_alias;
+        }
+        
+        mem_free(MEM_SCHEMA, table->name);
+        mem_free(MEM_SCHEMA, table->base_name);
+        mem_free(MEM_SCHEMA, table->object_signature);
         if (table->parent_table) {
-            free(table->parent_table);
+            mem_free(MEM_SCHEMA, table->parent_table);
         }
-        free(table);
+        mem_free(MEM_SCHEMA, table);
         
         table = next_table;
     }
     
-    free(context->output_dir);
-    free(context);
+    mem_free(MEM_SCHEMA, context->output_dir);
+    mem_free(MEM_SCHEMA, context);
 }
@@ -1,9 +1,12 @@
 #ifndef SCHEMA_H
 #define SCHEMA_H
 
+#include <stdint.h>
 #include "ast.h"
 
-/* Column types for our schema */
+/* Column types for our schema.
+ * Value columns widen along null < boolean < integer < number < string
+ * as conflicting values are seen during schema detection. */
 typedef enum {
     COL_ID,           /* Primary key */
     COL_FOREIGN_KEY,  /* Foreign key to parent table */
@@ -11,41 +14,77 @@ typedef enum {
     COL_STRING,       /* String value */
     COL_NUMBER,       /* Number value */
     COL_BOOLEAN,      /* Boolean value */
-    COL_NULL          /* Null value */
+    COL_NULL,         /* Null value */
+    COL_INTEGER       /* Number value that is always integral */
 } ColumnType;
 
+/* How row IDs are allocated */
+typedef enum {
+    ID_DENSE,      /* One sequence shared by all tables */
+    ID_PER_TABLE   /* Each table numbers its rows from 1 */
+} IdStrategy;
+
 /* Column definition */
 typedef struct Column {
     char *name;
     ColumnType type;
+    int segment;  /* File holding the column: 0 main CSV, n > 0 sidecar n */
     struct Column *next;
 } Column;
 
+/* Additional object shape merged into a table */
+typedef struct SignatureAlias {
+    char *signature;
+    struct SignatureAlias *next;
+} SignatureAlias;
+
 /* Table definition */
 typedef struct Table {
     char *name;
+    char *base_name;  /* Name asked for, before any _2, _3, ... suffix */
     Column *columns;
     struct Table *next;
     char *parent_table;  /* Name of parent table, if any */
     char *object_signature;  /* Signature of object shape */
+    SignatureAlias *aliases;  /* Other shapes unified into this table */
+    int stored;  /* Files already written by an earlier --append run */
+    int segments;  /* Files the stored columns are spread over */
+    int64_t next_id;  /* Per-table ID high-water mark carried between --append runs */
 } Table;
 
 /* Schema context */
 typedef struct SchemaContext {
     Table *tables;
     char *output_dir;
-    int print_ast;
+    int unify;  /* Merge overlapping shapes under the same key into one table */
+    int64_t next_id;  /* ID high-water mark carried between --append runs (0 if unknown) */
+    IdStrategy id_strategy;  /* Strategy of the run that wrote a loaded schema */
+    int id_strategy_loaded;  /* The loaded schema recorded its strategy */
+    int jobs;  /* Threads inferring a top-level array (1: serial) */
 } SchemaContext;
 
 /* Schema detection functions */
-SchemaContext* create_schema_context(const char *output_dir, int print_ast);
+SchemaContext* create_schema_context(const char *output_dir);
+
+/* Add the tables and columns of a document. A top-level array is taken as
+ * a sequence of root records; large ones are split across context->jobs
+ * threads and give the same schema as a serial pass. */
 void detect_schema(SchemaContext *context, JsonValue *root);
 void free_schema_context(SchemaContext *context);
 
 /* Helper functions */
 char* generate_object_signature(JsonValue *object);
+char* create_table_name(const char *key);
 Table* find_or_create_table(SchemaContext *context, const char *name, const char *object_signature);
 void add_column(Table *table, const char *name, ColumnType type);
+ColumnType column_type_for_value(JsonValue *value);
+ColumnType widen_column_type(ColumnType current, ColumnType seen);
 Table* find_table_by_signature(SchemaContext *context, const char *signature);
+void add_signature_alias(Table *table, const char *signature);
+
+/* Schema persistence (skip inference on recurring feeds) */
+void save_schema(SchemaContext *context, const char *path);
+void load_schema(SchemaContext *context, const char *path);
+void mark_schema_stored(SchemaContext *context);
 
 #endif /* SCHEMA_H */
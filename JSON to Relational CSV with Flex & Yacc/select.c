@@ -0,0 +1,196 @@
+#include "select.h"
+#include "mem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Allocate a node for key */
+static SelectNode* create_select_node(const char *key, size_t length) {
+    SelectNode *node = (SelectNode*)mem_calloc(MEM_SCHEMA, 1, sizeof(SelectNode));
+    if (!node) {
+        fprintf(stderr, "Memory allocation failed for selection\n");
+        exit(1);
+    }
+    node->key = (char*)mem_alloc(MEM_SCHEMA, length + 1);
+    if (!node->key) {
+        fprintf(stderr, "Memory allocation failed for selection\n");
+        exit(1);
+    }
+    memcpy(node->key, key, length);
+    node->key[length] = '\0';
+    return node;
+}
+
+SelectNode* create_selection(void) {
+    return create_select_node("$", 1);
+}
+
+/* Free the children of a node */
+static void free_select_children(SelectNode *node) {
+    SelectNode *child = node->children;
+    while (child) {
+        SelectNode *next = child->next;
+        free_select_children(child);
+        mem_free(MEM_SCHEMA, child->key);
+        mem_free(MEM_SCHEMA, child);
+        child = next;
+    }
+    node->children = NULL;
+}
+
+/* Child of node named exactly key, created if missing */
+static SelectNode* find_or_add_child(SelectNode *node, const char *key, size_t length) {
+    SelectNode *child = node->children;
+    SelectNode *last = NULL;
+    while (child) {
+        if (strlen(child->key) == length && memcmp(child->key, key, length) == 0) {
+            return child;
+        }
+        last = child;
+        child = child->next;
+    }
+
+    child = create_select_node(key, length);
+    if (last) {
+        last->next = child;
+    } else {
+        node->children = child;
+    }
+    return child;
+}
+
+/* Report a malformed path and exit */
+static void selection_error(const char *path, size_t length, const char *msg) {
+    fprintf(stderr, "Error: invalid --select path '%.*s': %s\n", (int)length, path, msg);
+    exit(1);
+}
+
+/* Add one path of the given length */
+static void add_selection_path(SelectNode *root, const char *path, size_t length) {
+    const char *p = path;
+    const char *end = path + length;
+    SelectNode *node = root;
+
+    if (p < end && *p == '$') {
+        p++;
+    }
+    if (p < end && *p == '.') {
+        p++;
+    }
+
+    while (p < end) {
+        if (*p == '[') {
+            /* Array steps only accept [*]; every element is visited anyway */
+            if (end - p < 3 || p[1] != '*' || p[2] != ']') {
+                selection_error(path, length, "only [*] is supported inside brackets");
+            }
+            p += 3;
+        } else {
+            const char *key = p;
+            while (p < end && *p != '.' && *p != '[') {
+                p++;
+            }
+            if (p == key) {
+                selection_error(path, length, "empty member name");
+            }
+            if (node->terminal) {
+                return;  /* A shorter path already keeps all of this */
+            }
+            node = find_or_add_child(node, key, p - key);
+        }
+
+        if (p < end && *p == '.') {
+            p++;
+            if (p == end) {
+                selection_error(path, length, "empty member name");
+            }
+        }
+    }
+
+    if (node == root) {
+        selection_error(path, length, "no member names");
+    }
+
+    /* Everything below a selected member is kept */
+    node->terminal = 1;
+    free_select_children(node);
+}
+
+void add_selection_paths(SelectNode *root, const char *paths) {
+    const char *p = paths;
+    for (;;) {
+        const char *comma = strchr(p, ',');
+        size_t length = comma ? (size_t)(comma - p) : strlen(p);
+        if (length > 0) {
+            add_selection_path(root, p, length);
+        }
+        if (!comma) {
+            break;
+        }
+        p = comma + 1;
+    }
+}
+
+/* Union the subtree of src into dst */
+static void merge_selection(SelectNode *dst, const SelectNode *src) {
+    if (dst->terminal) {
+        return;
+    }
+    if (src->terminal) {
+        dst->terminal = 1;
+        free_select_children(dst);
+        return;
+    }
+    const SelectNode *child = src->children;
+    while (child) {
+        merge_selection(find_or_add_child(dst, child->key, strlen(child->key)), child);
+        child = child->next;
+    }
+}
+
+void finish_selection(SelectNode *root) {
+    /* A named member matches its own paths and any "*" sibling's, so the
+     * wildcard's subtree is copied into each named sibling. Lookups can
+     * then stop at the first match. */
+    SelectNode *wildcard = NULL;
+    SelectNode *child = root->children;
+    while (child) {
+        if (strcmp(child->key, "*") == 0) {
+            wildcard = child;
+        }
+        child = child->next;
+    }
+
+    child = root->children;
+    while (child) {
+        if (wildcard && child != wildcard) {
+            merge_selection(child, wildcard);
+        }
+        finish_selection(child);
+        child = child->next;
+    }
+}
+
+const SelectNode* select_member(const SelectNode *node, const char *key) {
+    const SelectNode *wildcard = NULL;
+    const SelectNode *child = node->children;
+    while (child) {
+        if (strcmp(child->key, key) == 0) {
+            return child;
+        }
+        if (child->key[0] == '*' && child->key[1] == '\0') {
+            wildcard = child;
+        }
+        child = child->next;
+    }
+    return wildcard;
+}
+
+void free_selection(SelectNode *root) {
+    if (!root) {
+        return;
+    }
+    free_select_children(root);
+    mem_free(MEM_SCHEMA, root->key);
+    mem_free(MEM_SCHEMA, root);
+}
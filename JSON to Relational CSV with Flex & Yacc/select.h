@@ -0,0 +1,32 @@
+#ifndef SELECT_H
+#define SELECT_H
+
+/* Field projection for --select.
+ *
+ * Paths like "$.store.name", "users[*].address" or "items.*.id" are merged
+ * into a trie of member names. Arrays are transparent: a path continues
+ * through every element of an array found on it. A node marked terminal
+ * selects the whole value under it; a member with no node is skipped. */
+typedef struct SelectNode {
+    char *key;                    /* Member name, or "*" for any member */
+    int terminal;                 /* Keep everything below this member */
+    struct SelectNode *children;
+    struct SelectNode *next;      /* Sibling */
+} SelectNode;
+
+/* Create an empty selection rooted at the document ($) */
+SelectNode* create_selection(void);
+
+/* Add comma-separated paths. Exits with a message on a malformed path. */
+void add_selection_paths(SelectNode *root, const char *paths);
+
+/* Resolve "*" members against their named siblings; call once after the
+ * last add_selection_paths() */
+void finish_selection(SelectNode *root);
+
+/* Node for member key under node, or NULL if the member is not selected */
+const SelectNode* select_member(const SelectNode *node, const char *key);
+
+void free_selection(SelectNode *root);
+
+#endif /* SELECT_H */
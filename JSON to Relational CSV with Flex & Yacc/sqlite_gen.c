@@ -0,0 +1,510 @@
+#include "sqlite_gen.h"
+#include "stats.h"
+#include "mem.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_SQLITE
+#include <sqlite3.h>
+#include <sys/stat.h>
+#include "number_format.h"
+
+/* Rows inserted per transaction */
+#define SQLITE_BATCH_ROWS 100000
+
+/* What a column of a table is filled from */
+typedef enum {
+    SQL_ID,       /* Row ID */
+    SQL_PARENT,   /* ID of the parent row */
+    SQL_INDEX,    /* Position in the source array */
+    SQL_CHILD,    /* ID of the object nested under <key> */
+    SQL_VALUE     /* Scalar member, or a junction table's value */
+} SqlField;
+
+typedef struct SqlColumn {
+    Column *column;
+    SqlField field;
+} SqlColumn;
+
+/* Open transaction and the rows inserted in it */
+typedef struct SqlWriter {
+    sqlite3 *db;
+    CsvBuffer sql;           /* Statement text being built */
+    long pending;
+} SqlWriter;
+
+/* Report the database's last error and abort */
+static void sqlite_fail(sqlite3 *db, const char *what) {
+    fprintf(stderr, "SQLite error %s: %s\n", what, sqlite3_errmsg(db));
+    exit(1);
+}
+
+static void sqlite_exec(sqlite3 *db, const char *sql) {
+    char *message = NULL;
+    if (sqlite3_exec(db, sql, NULL, NULL, &message) != SQLITE_OK) {
+        fprintf(stderr, "SQLite error running %s: %s\n", sql, message ? message : sqlite3_errmsg(db));
+        exit(1);
+    }
+}
+
+static void sql_text(CsvBuffer *sql, const char *text) {
+    csv_buffer_append(sql, text, strlen(text));
+}
+
+/* Append a double-quoted identifier */
+static void sql_identifier(CsvBuffer *sql, const char *name) {
+    csv_buffer_append(sql, "\"", 1);
+    for (const char *p = name; *p; p++) {
+        if (*p == '"') {
+            csv_buffer_append(sql, "\"", 1);
+        }
+        csv_buffer_append(sql, p, 1);
+    }
+    csv_buffer_append(sql, "\"", 1);
+}
+
+/* Terminate the statement text and start over for the next one */
+static const char* sql_finish(CsvBuffer *sql) {
+    csv_buffer_append(sql, "", 1);
+    sql->length = 0;
+    return sql->data;
+}
+
+/* Declared type, which gives the column its SQLite affinity */
+static const char* sql_type(ColumnType type) {
+    switch (type) {
+        case COL_ID:
+        case COL_FOREIGN_KEY:
+        case COL_INDEX:
+        case COL_INTEGER:
+        case COL_BOOLEAN:
+            return "INTEGER";
+        case COL_NUMBER:
+            return "REAL";
+        case COL_STRING:
+            return "TEXT";
+        default:
+            return "";  /* Only nulls seen */
+    }
+}
+
+/* Table of the objects nested under the key of a <key>_id column, or NULL
+ * if there is none or several shapes share the key */
+static Table* nested_table(SchemaContext *schema, const char *column_name) {
+    char key[256];
+    size_t key_length = strlen(column_name) - 3;
+    if (key_length >= sizeof(key)) {
+        return NULL;
+    }
+    memcpy(key, column_name, key_length);
+    key[key_length] = '\0';
+
+    char *name = create_table_name(key);
+    Table *found = NULL;
+    int matches = 0;
+    Table *table = schema->tables;
+    while (table) {
+        if (strcmp(table->base_name, name) == 0 && strncmp(table->object_signature, "junction:", 9) != 0) {
+            found = table;
+            matches++;
+        }
+        table = table->next;
+    }
+    mem_free(MEM_SCHEMA, name);
+    return matches == 1 ? found : NULL;
+}
+
+/* Append a column definition */
+static void sql_column(CsvBuffer *sql, SchemaContext *schema, Table *owner, const SqlColumn *column) {
+    sql_identifier(sql, column->column->name);
+    const char *type = sql_type(column->column->type);
+    if (*type) {
+        sql_text(sql, " ");
+        sql_text(sql, type);
+    }
+
+    Table *referenced = NULL;
+    switch (column->field) {
+        case SQL_ID:
+            sql_text(sql, " PRIMARY KEY");
+            break;
+        case SQL_PARENT:
+            referenced = schema->tables;
+            while (referenced && (!owner->parent_table || strcmp(referenced->name, owner->parent_table) != 0)) {
+                referenced = referenced->next;
+            }
+            break;
+        case SQL_CHILD:
+            referenced = nested_table(schema, column->column->name);
+            break;
+        default:
+            break;
+    }
+    if (referenced) {
+        sql_text(sql, " REFERENCES ");
+        sql_identifier(sql, referenced->name);
+        sql_text(sql, "(\"id\")");
+    }
+}
+
+/* Classify the columns of a table the way the CSV writer fills them */
+static SqlColumn* resolve_columns(TableData *table_data, int *count) {
+    Table *schema = table_data->schema;
+    int capacity = 0;
+    Column *col = schema->columns;
+    while (col) {
+        capacity++;
+        col = col->next;
+    }
+    SqlColumn *columns = (SqlColumn*)mem_alloc(MEM_SCHEMA, (capacity + 1) * sizeof(SqlColumn));
+    if (!columns) {
+        fprintf(stderr, "Memory allocation failed for SQLite columns\n");
+        exit(1);
+    }
+
+    char parent_fk[256] = "";
+    if (schema->parent_table) {
+        snprintf(parent_fk, sizeof(parent_fk), "%s_id", schema->parent_table);
+    }
+
+    *count = 0;
+    col = schema->columns;
+    while (col) {
+        SqlField field;
+        if (col->type == COL_ID) {
+            field = SQL_ID;
+        } else if (col->type == COL_INDEX || (col->type == COL_FOREIGN_KEY && strcmp(col->name, "seq") == 0)) {
+            field = SQL_INDEX;
+        } else if (col->type == COL_FOREIGN_KEY && (table_data->junction || strcmp(col->name, parent_fk) == 0)) {
+            field = SQL_PARENT;
+        } else if (col->type == COL_FOREIGN_KEY) {
+            field = SQL_CHILD;
+        } else {
+            field = SQL_VALUE;
+        }
+        columns[*count].column = col;
+        columns[(*count)++].field = field;
+        col = col->next;
+    }
+    return columns;
+}
+
+/* Create the table, or add the columns a stored table is missing.
+ * Tables not stored by an earlier --append run replace any old table. */
+static void create_sqlite_table(SqlWriter *writer, SchemaContext *schema, TableData *table_data,
+                                const SqlColumn *columns, int count) {
+    CsvBuffer *sql = &writer->sql;
+    Table *table = table_data->schema;
+
+    if (!table->stored) {
+        sql_text(sql, "DROP TABLE IF EXISTS ");
+        sql_identifier(sql, table->name);
+        sqlite_exec(writer->db, sql_finish(sql));
+    }
+
+    /* Columns the database already has */
+    sqlite3_stmt *info;
+    if (sqlite3_prepare_v2(writer->db, "SELECT name FROM pragma_table_info(?)", -1, &info, NULL) != SQLITE_OK) {
+        sqlite_fail(writer->db, "reading table columns");
+    }
+    sqlite3_bind_text(info, 1, table->name, -1, SQLITE_STATIC);
+    char **existing = NULL;
+    int existing_count = 0;
+    while (sqlite3_step(info) == SQLITE_ROW) {
+        existing = (char**)mem_realloc(MEM_SCHEMA, existing, (existing_count + 1) * sizeof(char*));
+        if (!existing) {
+            fprintf(stderr, "Memory allocation failed for SQLite columns\n");
+            exit(1);
+        }
+        existing[existing_count++] = mem_strdup(MEM_SCHEMA, (const char*)sqlite3_column_text(info, 0));
+    }
+    sqlite3_finalize(info);
+
+    if (existing_count == 0) {
+        sql_text(sql, "CREATE TABLE ");
+        sql_identifier(sql, table->name);
+        sql_text(sql, " (");
+        for (int c = 0; c < count; c++) {
+            if (c > 0) {
+                sql_text(sql, ", ");
+            }
+            sql_column(sql, schema, table, &columns[c]);
+        }
+        sql_text(sql, ")");
+        sqlite_exec(writer->db, sql_finish(sql));
+    } else {
+        for (int c = 0; c < count; c++) {
+            int found = 0;
+            for (int i = 0; i < existing_count && !found; i++) {
+                found = strcmp(existing[i], columns[c].column->name) == 0;
+            }
+            if (!found) {
+                sql_text(sql, "ALTER TABLE ");
+                sql_identifier(sql, table->name);
+                sql_text(sql, " ADD COLUMN ");
+                sql_column(sql, schema, table, &columns[c]);
+                sqlite_exec(writer->db, sql_finish(sql));
+            }
+        }
+    }
+
+    for (int i = 0; i < existing_count; i++) {
+        mem_free(MEM_SCHEMA, existing[i]);
+    }
+    mem_free(MEM_SCHEMA, existing);
+}
+
+/* Prepare the INSERT for every column of a table */
+static sqlite3_stmt* prepare_insert(SqlWriter *writer, Table *table, const SqlColumn *columns, int count) {
+    CsvBuffer *sql = &writer->sql;
+    sql_text(sql, "INSERT INTO ");
+    sql_identifier(sql, table->name);
+    sql_text(sql, " (");
+    for (int c = 0; c < count; c++) {
+        if (c > 0) {
+            sql_text(sql, ", ");
+        }
+        sql_identifier(sql, columns[c].column->name);
+    }
+    sql_text(sql, ") VALUES (");
+    for (int c = 0; c < count; c++) {
+        sql_text(sql, c > 0 ? ", ?" : "?");
+    }
+    sql_text(sql, ")");
+
+    sqlite3_stmt *insert;
+    if (sqlite3_prepare_v2(writer->db, sql_finish(sql), -1, &insert, NULL) != SQLITE_OK) {
+        sqlite_fail(writer->db, "preparing insert");
+    }
+    return insert;
+}
+
+/* Bind a typed scalar. Text columns get the same text as the CSV output;
+ * numeric columns get numbers, with booleans as 1 and 0. */
+static void bind_scalar(sqlite3_stmt *insert, int index, JsonType json_type, const ScalarValue *value, ColumnType type) {
+    char text[NUMBER_FORMAT_MAX];
+    switch (json_type) {
+        case JSON_STRING:
+            sqlite3_bind_text(insert, index, value->string, -1, SQLITE_STATIC);
+            break;
+
+        case JSON_NUMBER:
+            if (type == COL_INTEGER && number_is_exact_integer(value->number)) {
+                sqlite3_bind_int64(insert, index, (int64_t)value->number);
+            } else if (type == COL_STRING) {
+                int length = format_double(value->number, text);
+                sqlite3_bind_text(insert, index, text, length, SQLITE_TRANSIENT);
+            } else {
+                sqlite3_bind_double(insert, index, value->number);
+            }
+            break;
+
+        case JSON_BOOLEAN:
+            if (type == COL_STRING) {
+                sqlite3_bind_text(insert, index, value->boolean ? "true" : "false", -1, SQLITE_STATIC);
+            } else {
+                sqlite3_bind_int(insert, index, value->boolean);
+            }
+            break;
+
+        default:
+            sqlite3_bind_null(insert, index);
+            break;
+    }
+}
+
+static void bind_value(sqlite3_stmt *insert, int index, JsonValue *value, ColumnType type) {
+    ScalarValue scalar;
+    switch (value->type) {
+        case JSON_STRING:
+            scalar.string = json_string_text(value);
+            break;
+        case JSON_NUMBER:
+            scalar.number = value->value.number_value;
+            break;
+        case JSON_BOOLEAN:
+            scalar.boolean = value->value.boolean_value;
+            break;
+        default:
+            scalar.string = NULL;
+            break;
+    }
+    bind_scalar(insert, index, value->type, &scalar, type);
+}
+
+/* Run the bound insert, committing every SQLITE_BATCH_ROWS rows */
+static void insert_row(SqlWriter *writer, sqlite3_stmt *insert) {
+    if (sqlite3_step(insert) != SQLITE_DONE) {
+        sqlite_fail(writer->db, "inserting row");
+    }
+    sqlite3_reset(insert);
+    run_stats.rows++;
+
+    if (++writer->pending >= SQLITE_BATCH_ROWS) {
+        sqlite_exec(writer->db, "COMMIT");
+        sqlite_exec(writer->db, "BEGIN");
+        writer->pending = 0;
+    }
+}
+
+/* Insert the rows of a scalar-array table from its typed vectors */
+static void insert_junction_rows(SqlWriter *writer, sqlite3_stmt *insert, JunctionData *junction,
+                                 const SqlColumn *columns, int count) {
+    for (size_t r = 0; r < junction->run_count; r++) {
+        JunctionRun *run = &junction->runs[r];
+        for (size_t i = 0; i < run->count; i++) {
+            size_t v = run->start + i;
+            for (int c = 0; c < count; c++) {
+                switch (columns[c].field) {
+                    case SQL_ID:
+                        sqlite3_bind_int64(insert, c + 1, run->first_id + (int64_t)i);
+                        break;
+                    case SQL_PARENT:
+                        sqlite3_bind_int64(insert, c + 1, run->parent_id);
+                        break;
+                    case SQL_INDEX:
+                        sqlite3_bind_int64(insert, c + 1, (int64_t)i);
+                        break;
+                    case SQL_VALUE:
+                        if (strcmp(columns[c].column->name, "value") == 0) {
+                            bind_scalar(insert, c + 1, (JsonType)junction->types[v], &junction->values[v],
+                                        columns[c].column->type);
+                        } else {
+                            sqlite3_bind_null(insert, c + 1);
+                        }
+                        break;
+                    default:
+                        sqlite3_bind_null(insert, c + 1);
+                        break;
+                }
+            }
+            insert_row(writer, insert);
+        }
+    }
+}
+
+/* Insert the rows of an object table */
+static void insert_object_rows(SqlWriter *writer, sqlite3_stmt *insert, RowData *row,
+                               const SqlColumn *columns, int count) {
+    while (row) {
+        for (int c = 0; c < count; c++) {
+            Column *col = columns[c].column;
+            int bound = 0;
+            switch (columns[c].field) {
+                case SQL_ID:
+                    sqlite3_bind_int64(insert, c + 1, row->id);
+                    bound = 1;
+                    break;
+
+                case SQL_PARENT:
+                    sqlite3_bind_int64(insert, c + 1, row->parent_id);
+                    bound = 1;
+                    break;
+
+                case SQL_INDEX:
+                    sqlite3_bind_int64(insert, c + 1, row->array_index);
+                    bound = 1;
+                    break;
+
+                case SQL_CHILD: {
+                    /* <key>_id of a nested object; NULL when it was null or absent */
+                    size_t key_length = strlen(col->name) - 3;
+                    ChildRef *ref = row->children;
+                    while (ref && !bound) {
+                        if (strncmp(ref->key, col->name, key_length) == 0 && ref->key[key_length] == '\0') {
+                            sqlite3_bind_int64(insert, c + 1, ref->id);
+                            bound = 1;
+                        }
+                        ref = ref->next;
+                    }
+                    break;
+                }
+
+                case SQL_VALUE:
+                    if (row->data->type == JSON_OBJECT) {
+                        KeyValuePair *pair = row->data->value.object_head;
+                        while (pair) {
+                            if (strcmp(pair->key, col->name) == 0) {
+                                bind_value(insert, c + 1, &pair->value, col->type);
+                                bound = 1;
+                                break;
+                            }
+                            pair = pair->next;
+                        }
+                    } else if (strcmp(col->name, "value") == 0) {
+                        bind_value(insert, c + 1, row->data, col->type);
+                        bound = 1;
+                    }
+                    break;
+            }
+            if (!bound) {
+                sqlite3_bind_null(insert, c + 1);
+            }
+        }
+        insert_row(writer, insert);
+        row = row->next;
+    }
+}
+
+/* Size of a file, or 0 if it does not exist */
+static long file_size(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0 ? (long)st.st_size : 0;
+}
+
+void write_sqlite_database(CsvContext *context, const char *path) {
+    SqlWriter writer;
+    memset(&writer, 0, sizeof(writer));
+    long size_before = file_size(path);
+
+    if (sqlite3_open(path, &writer.db) != SQLITE_OK) {
+        fprintf(stderr, "Error opening SQLite database %s: %s\n", path, sqlite3_errmsg(writer.db));
+        exit(1);
+    }
+
+    /* A bulk load: the file is not kept consistent across a crash */
+    sqlite_exec(writer.db, "PRAGMA synchronous = OFF");
+    sqlite_exec(writer.db, "PRAGMA journal_mode = MEMORY");
+    sqlite_exec(writer.db, "BEGIN");
+
+    TableData *table_data = context->tables;
+    while (table_data) {
+        int count;
+        SqlColumn *columns = resolve_columns(table_data, &count);
+        create_sqlite_table(&writer, context->schema, table_data, columns, count);
+
+        sqlite3_stmt *insert = prepare_insert(&writer, table_data->schema, columns, count);
+        if (table_data->junction) {
+            insert_junction_rows(&writer, insert, table_data->junction, columns, count);
+        }
+        insert_object_rows(&writer, insert, table_data->rows, columns, count);
+        sqlite3_finalize(insert);
+
+        mem_free(MEM_SCHEMA, columns);
+        run_stats.tables++;
+        table_data = table_data->next;
+    }
+
+    sqlite_exec(writer.db, "COMMIT");
+    if (sqlite3_close(writer.db) != SQLITE_OK) {
+        sqlite_fail(writer.db, "closing database");
+    }
+    mem_free(MEM_OUTPUT, writer.sql.data);
+
+    long size_after = file_size(path);
+    if (size_after > size_before) {
+        run_stats.bytes_written += size_after - size_before;
+    }
+}
+
+#else
+
+void write_sqlite_database(CsvContext *context, const char *path) {
+    (void)context;
+    (void)path;
+    fprintf(stderr, "Error: SQLite support not compiled in (build with SQLITE=1)\n");
+    exit(1);
+}
+
+#endif /* HAVE_SQLITE */
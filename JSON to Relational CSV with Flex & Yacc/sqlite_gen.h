@@ -0,0 +1,19 @@
+#ifndef SQLITE_GEN_H
+#define SQLITE_GEN_H
+
+#include "csv_gen.h"
+
+/* Write the extracted rows to an SQLite database instead of CSV files.
+ *
+ * Every table becomes an SQLite table with an INTEGER PRIMARY KEY id, its
+ * parent key declared as REFERENCES the parent table and each <key>_id
+ * column declared as REFERENCES the table of the nested object when that
+ * table is unambiguous. Rows go through one prepared INSERT per table and
+ * are committed in large transactions. Tables of the current run replace
+ * existing ones of the same name; tables stored by an earlier --append run
+ * are kept, gain any new columns and get the new rows.
+ *
+ * Needs HAVE_SQLITE; otherwise reports that support is missing and exits. */
+void write_sqlite_database(CsvContext *context, const char *path);
+
+#endif /* SQLITE_GEN_H */
@@ -0,0 +1,97 @@
+#include "stats.h"
+#include "mem.h"
+#include <time.h>
+
+/* Counters for the current run, one copy per thread */
+__thread RunStats run_stats;
+
+/* Clock used for phase CPU times */
+static __thread clockid_t cpu_clock = CLOCK_PROCESS_CPUTIME_ID;
+
+static const char *phase_names[PHASE_COUNT] = {
+    "parse", "schema", "extract", "write"
+};
+
+/* Read a clock in milliseconds */
+static double clock_ms(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+/* Start timing a phase */
+void stats_phase_begin(Phase phase) {
+    PhaseTiming *timing = &run_stats.phases[phase];
+    timing->wall_start = clock_ms(CLOCK_MONOTONIC);
+    timing->cpu_start = clock_ms(cpu_clock);
+}
+
+/* Stop timing a phase; repeated phases accumulate */
+void stats_phase_end(Phase phase) {
+    PhaseTiming *timing = &run_stats.phases[phase];
+    timing->wall_ms += clock_ms(CLOCK_MONOTONIC) - timing->wall_start;
+    timing->cpu_ms += clock_ms(cpu_clock) - timing->cpu_start;
+}
+
+/* Measure this thread's CPU time only */
+void stats_use_thread_clock(void) {
+    cpu_clock = CLOCK_THREAD_CPUTIME_ID;
+}
+
+/* Add the counters and phase times of one run to another */
+void stats_accumulate(RunStats *into, const RunStats *from) {
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        into->phases[i].wall_ms += from->phases[i].wall_ms;
+        into->phases[i].cpu_ms += from->phases[i].cpu_ms;
+    }
+    into->ast_nodes += from->ast_nodes;
+    into->ast_links += from->ast_links;
+    into->ast_bytes += from->ast_bytes;
+    into->tables += from->tables;
+    into->rows += from->rows;
+    into->rows_deduplicated += from->rows_deduplicated;
+    into->rows_filtered += from->rows_filtered;
+    into->bytes_written += from->bytes_written;
+}
+
+/* Print a human-readable report */
+void print_stats(FILE *out) {
+    double wall_total = 0, cpu_total = 0;
+
+    fprintf(out, "%-10s %12s %12s\n", "phase", "wall_ms", "cpu_ms");
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        fprintf(out, "%-10s %12.3f %12.3f\n", phase_names[i],
+                run_stats.phases[i].wall_ms, run_stats.phases[i].cpu_ms);
+        wall_total += run_stats.phases[i].wall_ms;
+        cpu_total += run_stats.phases[i].cpu_ms;
+    }
+    fprintf(out, "%-10s %12.3f %12.3f\n", "total", wall_total, cpu_total);
+
+    fprintf(out, "ast nodes:     %lu\n", run_stats.ast_nodes);
+    fprintf(out, "ast links:     %lu\n", run_stats.ast_links);
+    fprintf(out, "ast bytes:     %lu\n", run_stats.ast_bytes);
+    fprintf(out, "tables:        %lu\n", run_stats.tables);
+    fprintf(out, "rows:          %lu\n", run_stats.rows);
+    fprintf(out, "rows deduped:  %lu\n", run_stats.rows_deduplicated);
+    fprintf(out, "rows filtered: %lu\n", run_stats.rows_filtered);
+    fprintf(out, "bytes written: %lu\n", run_stats.bytes_written);
+}
+
+/* Print the report as a single JSON object */
+void print_stats_json(FILE *out) {
+    fprintf(out, "{\"phases\": {");
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        fprintf(out, "%s\"%s\": {\"wall_ms\": %.3f, \"cpu_ms\": %.3f}",
+                i ? ", " : "", phase_names[i],
+                run_stats.phases[i].wall_ms, run_stats.phases[i].cpu_ms);
+    }
+    fprintf(out, "}, \"ast_nodes\": %lu, \"ast_links\": %lu, \"ast_bytes\": %lu, "
+                 "\"tables\": %lu, \"rows\": %lu, \"rows_deduplicated\": %lu, \"rows_filtered\": %lu, \"bytes_written\": %lu",
+            run_stats.ast_nodes, run_stats.ast_links, run_stats.ast_bytes,
+            run_stats.tables, run_stats.rows, run_stats.rows_deduplicated, run_stats.rows_filtered, run_stats.bytes_written);
+    if (mem_accounting) {
+        fprintf(out, ", \"memory\": ");
+        print_mem_stats_json(out);
+    }
+    fprintf(out, "}\n");
+}
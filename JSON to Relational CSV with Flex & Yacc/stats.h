@@ -0,0 +1,55 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+
+/* Pipeline phases that are timed separately */
+typedef enum {
+    PHASE_PARSE,      /* Lexing and parsing into the AST */
+    PHASE_SCHEMA,     /* Schema detection (or loading) */
+    PHASE_EXTRACT,    /* Row extraction */
+    PHASE_WRITE,      /* CSV output */
+    PHASE_COUNT
+} Phase;
+
+/* Wall clock and CPU time spent in one phase */
+typedef struct PhaseTiming {
+    double wall_ms;
+    double cpu_ms;
+    double wall_start;
+    double cpu_start;
+} PhaseTiming;
+
+/* Counters collected over one conversion run */
+typedef struct RunStats {
+    PhaseTiming phases[PHASE_COUNT];
+    unsigned long ast_nodes;      /* JsonValue nodes created */
+    unsigned long ast_links;      /* Key-value pairs and array elements */
+    unsigned long ast_bytes;      /* Bytes allocated for the AST */
+    unsigned long tables;         /* Tables written */
+    unsigned long rows;           /* Rows written */
+    unsigned long rows_deduplicated;  /* Nested objects that reused an equal row (--dedup) */
+    unsigned long rows_filtered;  /* Objects dropped by --where, not counting their children */
+    unsigned long bytes_written;  /* Bytes of CSV output */
+} RunStats;
+
+/* Counters of the calling thread; batch workers add theirs to the main
+ * thread's with stats_accumulate() */
+extern __thread RunStats run_stats;
+
+/* Phase timing */
+void stats_phase_begin(Phase phase);
+void stats_phase_end(Phase phase);
+
+/* Measure this thread's CPU time instead of the whole process's, so that
+ * phases timed by concurrent workers can be added up */
+void stats_use_thread_clock(void);
+
+/* Add the counters and phase times of one run to another */
+void stats_accumulate(RunStats *into, const RunStats *from);
+
+/* Reporting */
+void print_stats(FILE *out);
+void print_stats_json(FILE *out);
+
+#endif /* STATS_H */
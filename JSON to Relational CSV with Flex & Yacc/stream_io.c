@@ -0,0 +1,588 @@
+#include "stream_io.h"
+#include "mem.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#define STREAM_CHUNK (128 * 1024)
+
+/* Parse a codec name from the command line */
+int parse_codec(const char *name, Codec *codec) {
+    if (strcmp(name, "none") == 0) {
+        *codec = CODEC_NONE;
+    } else if (strcmp(name, "gzip") == 0 || strcmp(name, "gz") == 0) {
+        *codec = CODEC_GZIP;
+    } else if (strcmp(name, "zstd") == 0 || strcmp(name, "zst") == 0) {
+        *codec = CODEC_ZSTD;
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+/* File name suffix for a codec */
+const char* codec_extension(Codec codec) {
+    switch (codec) {
+        case CODEC_GZIP: return ".gz";
+        case CODEC_ZSTD: return ".zst";
+        default:         return "";
+    }
+}
+
+/* Check that support for a codec was compiled in */
+static int codec_available(Codec codec) {
+    switch (codec) {
+#ifndef HAVE_ZLIB
+        case CODEC_GZIP:
+            fprintf(stderr, "Error: gzip support not compiled in (build with ZLIB=1)\n");
+            return 0;
+#endif
+#ifndef HAVE_ZSTD
+        case CODEC_ZSTD:
+            fprintf(stderr, "Error: zstd support not compiled in (build with ZSTD=1)\n");
+            return 0;
+#endif
+        default:
+            return 1;
+    }
+}
+
+/* Write a whole buffer to a file descriptor */
+static int write_all(int fd, const void *data, size_t len) {
+    const char *p = (const char*)data;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+/* Start a worker thread connected to one end of a new pipe.
+ * Returns the other end, or -1 on failure. */
+static int start_pipe_thread(pthread_t *thread, void *(*worker)(void *), void *arg, int *worker_fd, int reader) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        fprintf(stderr, "Error creating pipe: %s\n", strerror(errno));
+        return -1;
+    }
+
+    /* A reader that stops early must not kill the process with SIGPIPE */
+    signal(SIGPIPE, SIG_IGN);
+
+    *worker_fd = reader ? fds[0] : fds[1];
+    if (pthread_create(thread, NULL, worker, arg) != 0) {
+        fprintf(stderr, "Error starting stream thread\n");
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+    return reader ? fds[1] : fds[0];
+}
+
+/* ---- Input ---------------------------------------------------------- */
+
+/* Arguments for the decoder thread */
+typedef struct InputWorker {
+    InputStream *in;
+    int out_fd;
+} InputWorker;
+
+/* Copy the source unchanged (used when sniffing consumed bytes from a pipe) */
+static int copy_plain(InputStream *in, int out_fd) {
+    char *buf = (char*)mem_alloc(MEM_INPUT, STREAM_CHUNK);
+    if (!buf) {
+        return -1;
+    }
+
+    int status = write_all(out_fd, in->magic, in->magic_len);
+    size_t n;
+    while (status == 0 && (n = fread(buf, 1, STREAM_CHUNK, in->raw)) > 0) {
+        status = write_all(out_fd, buf, n);
+    }
+
+    mem_free(MEM_INPUT, buf);
+    return status;
+}
+
+#ifdef HAVE_ZLIB
+/* Inflate gzip data (including concatenated members) */
+static int decode_gzip(InputStream *in, int out_fd) {
+    unsigned char *inbuf = (unsigned char*)mem_alloc(MEM_INPUT, STREAM_CHUNK);
+    unsigned char *outbuf = (unsigned char*)mem_alloc(MEM_INPUT, STREAM_CHUNK);
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (!inbuf || !outbuf || inflateInit2(&zs, 15 + 32) != Z_OK) {
+        mem_free(MEM_INPUT, inbuf);
+        mem_free(MEM_INPUT, outbuf);
+        return -1;
+    }
+
+    memcpy(inbuf, in->magic, in->magic_len);
+    zs.next_in = inbuf;
+    zs.avail_in = in->magic_len;
+
+    int status = 0;
+    int finished = 0;
+    int output_full = 0;
+    for (;;) {
+        /* Refill only once zlib has flushed everything it holds */
+        if (zs.avail_in == 0 && !output_full) {
+            size_t n = fread(inbuf, 1, STREAM_CHUNK, in->raw);
+            if (n == 0) {
+                break;
+            }
+            zs.next_in = inbuf;
+            zs.avail_in = n;
+        }
+
+        zs.next_out = outbuf;
+        zs.avail_out = STREAM_CHUNK;
+        int ret = inflate(&zs, Z_NO_FLUSH);
+        if (ret == Z_NEED_DICT || ret == Z_DATA_ERROR || ret == Z_MEM_ERROR || ret == Z_STREAM_ERROR) {
+            fprintf(stderr, "Error: corrupt gzip input: %s\n", zs.msg ? zs.msg : "inflate failed");
+            status = -1;
+            break;
+        }
+
+        size_t have = STREAM_CHUNK - zs.avail_out;
+        output_full = zs.avail_out == 0;
+        if (have > 0 && write_all(out_fd, outbuf, have) != 0) {
+            status = -1;  /* Parser stopped reading */
+            break;
+        }
+
+        if (ret == Z_STREAM_END) {
+            finished = 1;
+            inflateReset(&zs);  /* Another member may follow */
+        } else if (have > 0 || ret == Z_OK) {
+            finished = 0;
+        }
+    }
+
+    if (status == 0 && !finished) {
+        fprintf(stderr, "Error: truncated gzip input\n");
+        status = -1;
+    }
+
+    inflateEnd(&zs);
+    mem_free(MEM_INPUT, inbuf);
+    mem_free(MEM_INPUT, outbuf);
+    return status;
+}
+#endif
+
+#ifdef HAVE_ZSTD
+/* Decompress zstd data (including concatenated frames) */
+static int decode_zstd(InputStream *in, int out_fd) {
+    size_t in_cap = ZSTD_DStreamInSize();
+    size_t out_cap = ZSTD_DStreamOutSize();
+    if (in_cap < in->magic_len) {
+        in_cap = in->magic_len;
+    }
+    char *inbuf = (char*)mem_alloc(MEM_INPUT, in_cap);
+    char *outbuf = (char*)mem_alloc(MEM_INPUT, out_cap);
+    ZSTD_DStream *ds = ZSTD_createDStream();
+    if (!inbuf || !outbuf || !ds) {
+        mem_free(MEM_INPUT, inbuf);
+        mem_free(MEM_INPUT, outbuf);
+        ZSTD_freeDStream(ds);
+        return -1;
+    }
+    ZSTD_initDStream(ds);
+
+    memcpy(inbuf, in->magic, in->magic_len);
+    ZSTD_inBuffer input = {inbuf, in->magic_len, 0};
+
+    int status = 0;
+    size_t remaining = 1;  /* Nonzero while a frame is incomplete */
+    int output_full = 0;
+    for (;;) {
+        if (input.pos == input.size && !output_full) {
+            size_t n = fread(inbuf, 1, in_cap, in->raw);
+            if (n == 0) {
+                break;
+            }
+            input.size = n;
+            input.pos = 0;
+        }
+
+        ZSTD_outBuffer output = {outbuf, out_cap, 0};
+        remaining = ZSTD_decompressStream(ds, &output, &input);
+        if (ZSTD_isError(remaining)) {
+            fprintf(stderr, "Error: corrupt zstd input: %s\n", ZSTD_getErrorName(remaining));
+            status = -1;
+            break;
+        }
+
+        output_full = output.pos == output.size;
+        if (output.pos > 0 && write_all(out_fd, outbuf, output.pos) != 0) {
+            status = -1;
+            break;
+        }
+    }
+
+    if (status == 0 && remaining != 0) {
+        fprintf(stderr, "Error: truncated zstd input\n");
+        status = -1;
+    }
+
+    ZSTD_freeDStream(ds);
+    mem_free(MEM_INPUT, inbuf);
+    mem_free(MEM_INPUT, outbuf);
+    return status;
+}
+#endif
+
+/* Decoder thread: feed decoded bytes into the pipe the parser reads */
+static void* input_worker(void *arg) {
+    InputWorker *worker = (InputWorker*)arg;
+    InputStream *in = worker->in;
+
+    switch (in->codec) {
+#ifdef HAVE_ZLIB
+        case CODEC_GZIP:
+            in->status = decode_gzip(in, worker->out_fd);
+            break;
+#endif
+#ifdef HAVE_ZSTD
+        case CODEC_ZSTD:
+            in->status = decode_zstd(in, worker->out_fd);
+            break;
+#endif
+        default:
+            in->status = copy_plain(in, worker->out_fd);
+            break;
+    }
+
+    /* Closing the write end signals end of input to the parser */
+    close(worker->out_fd);
+    mem_free(MEM_INPUT, worker);
+    return NULL;
+}
+
+/* Open an input stream (NULL path reads stdin), detecting gzip/zstd by magic bytes */
+InputStream* open_input_stream(const char *path) {
+    InputStream *in = (InputStream*)mem_calloc(MEM_INPUT, 1, sizeof(InputStream));
+    if (!in) {
+        fprintf(stderr, "Memory allocation failed for input stream\n");
+        exit(1);
+    }
+
+    in->raw = path ? fopen(path, "rb") : stdin;
+    if (!in->raw) {
+        fprintf(stderr, "Error opening input file %s: %s\n", path, strerror(errno));
+        mem_free(MEM_INPUT, in);
+        return NULL;
+    }
+
+    /* Neither magic number can start a JSON document, so one byte decides
+       whether plain input can be handed over with a single ungetc */
+    int c = getc(in->raw);
+    if (c != 0x1f && c != 0x28) {
+        if (c != EOF) {
+            ungetc(c, in->raw);
+        }
+        in->file = in->raw;
+        in->codec = CODEC_NONE;
+        return in;
+    }
+
+    in->magic[in->magic_len++] = (unsigned char)c;
+    size_t want = c == 0x1f ? 2 : 4;
+    while (in->magic_len < want && (c = getc(in->raw)) != EOF) {
+        in->magic[in->magic_len++] = (unsigned char)c;
+    }
+
+    static const unsigned char gzip_magic[] = {0x1f, 0x8b};
+    static const unsigned char zstd_magic[] = {0x28, 0xb5, 0x2f, 0xfd};
+    if (in->magic_len == 2 && memcmp(in->magic, gzip_magic, 2) == 0) {
+        in->codec = CODEC_GZIP;
+    } else if (in->magic_len == 4 && memcmp(in->magic, zstd_magic, 4) == 0) {
+        in->codec = CODEC_ZSTD;
+    } else {
+        in->codec = CODEC_NONE;  /* Replay the sniffed bytes; the parser reports the error */
+    }
+
+    if (!codec_available(in->codec)) {
+        if (path) {
+            fclose(in->raw);
+        }
+        mem_free(MEM_INPUT, in);
+        return NULL;
+    }
+
+    InputWorker *worker = (InputWorker*)mem_alloc(MEM_INPUT, sizeof(InputWorker));
+    if (!worker) {
+        fprintf(stderr, "Memory allocation failed for input stream\n");
+        exit(1);
+    }
+    worker->in = in;
+
+    int read_fd = start_pipe_thread(&in->thread, input_worker, worker, &worker->out_fd, 0);
+    if (read_fd < 0) {
+        exit(1);
+    }
+    in->has_thread = 1;
+
+    in->file = fdopen(read_fd, "r");
+    if (!in->file) {
+        fprintf(stderr, "Error opening decompressed input stream: %s\n", strerror(errno));
+        exit(1);
+    }
+    return in;
+}
+
+/* Close an input stream; returns nonzero if decoding failed */
+int close_input_stream(InputStream *in) {
+    if (!in) {
+        return 0;
+    }
+
+    int status = 0;
+    if (in->has_thread) {
+        /* Closing the read end unblocks a decoder the parser abandoned */
+        fclose(in->file);
+        pthread_join(in->thread, NULL);
+        status = in->status;
+    }
+    if (in->raw != stdin) {
+        fclose(in->raw);
+    }
+
+    mem_free(MEM_INPUT, in);
+    return status;
+}
+
+/* ---- Output --------------------------------------------------------- */
+
+#ifdef HAVE_ZLIB
+/* Compress everything arriving on fd into a gzip file */
+static int encode_gzip(OutputStream *out, char *buf) {
+    gzFile gz = gzopen(out->path, out->append ? "ab6" : "wb6");
+    if (!gz) {
+        fprintf(stderr, "Error opening file %s for writing: %s\n", out->path, strerror(errno));
+        return -1;
+    }
+    gzbuffer(gz, STREAM_CHUNK);
+
+    int status = 0;
+    ssize_t n;
+    while ((n = read(out->pipe_fd, buf, STREAM_CHUNK)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            status = -1;
+            break;
+        }
+        if (gzwrite(gz, buf, (unsigned)n) != (int)n) {
+            status = -1;
+            break;
+        }
+    }
+
+    if (gzclose(gz) != Z_OK) {
+        status = -1;
+    }
+    return status;
+}
+#endif
+
+#ifdef HAVE_ZSTD
+/* Compress everything arriving on fd into a zstd file */
+static int encode_zstd(OutputStream *out, char *buf) {
+    FILE *file = fopen(out->path, out->append ? "ab" : "wb");
+    if (!file) {
+        fprintf(stderr, "Error opening file %s for writing: %s\n", out->path, strerror(errno));
+        return -1;
+    }
+
+    size_t out_cap = ZSTD_CStreamOutSize();
+    char *outbuf = (char*)mem_alloc(MEM_OUTPUT, out_cap);
+    ZSTD_CStream *cs = ZSTD_createCStream();
+    if (!outbuf || !cs) {
+        mem_free(MEM_OUTPUT, outbuf);
+        ZSTD_freeCStream(cs);
+        fclose(file);
+        return -1;
+    }
+    ZSTD_initCStream(cs, 3);
+
+    int status = 0;
+    ssize_t n;
+    while (status == 0 && (n = read(out->pipe_fd, buf, STREAM_CHUNK)) != 0) {
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            status = -1;
+            break;
+        }
+
+        ZSTD_inBuffer input = {buf, (size_t)n, 0};
+        while (input.pos < input.size) {
+            ZSTD_outBuffer output = {outbuf, out_cap, 0};
+            size_t ret = ZSTD_compressStream(cs, &output, &input);
+            if (ZSTD_isError(ret) || fwrite(outbuf, 1, output.pos, file) != output.pos) {
+                status = -1;
+                break;
+            }
+        }
+    }
+
+    /* Flush the final frame */
+    size_t remaining = 1;
+    while (status == 0 && remaining != 0) {
+        ZSTD_outBuffer output = {outbuf, out_cap, 0};
+        remaining = ZSTD_endStream(cs, &output);
+        if (ZSTD_isError(remaining) || fwrite(outbuf, 1, output.pos, file) != output.pos) {
+            status = -1;
+        }
+    }
+
+    ZSTD_freeCStream(cs);
+    mem_free(MEM_OUTPUT, outbuf);
+    if (fclose(file) != 0) {
+        status = -1;
+    }
+    return status;
+}
+#endif
+
+/* Compressor thread: drain the pipe the CSV writer fills */
+static void* output_worker(void *arg) {
+    OutputStream *out = (OutputStream*)arg;
+    char *buf = (char*)mem_alloc(MEM_OUTPUT, STREAM_CHUNK);
+    if (!buf) {
+        out->status = -1;
+    } else {
+        switch (out->codec) {
+#ifdef HAVE_ZLIB
+            case CODEC_GZIP:
+                out->status = encode_gzip(out, buf);
+                break;
+#endif
+#ifdef HAVE_ZSTD
+            case CODEC_ZSTD:
+                out->status = encode_zstd(out, buf);
+                break;
+#endif
+            default:
+                out->status = -1;
+                break;
+        }
+    }
+
+    /* Drain whatever is left so the writer never blocks after a failure */
+    if (buf) {
+        while (read(out->pipe_fd, buf, STREAM_CHUNK) > 0) {
+        }
+    }
+
+    mem_free(MEM_OUTPUT, buf);
+    close(out->pipe_fd);
+    return NULL;
+}
+
+/* Open an output file, compressing on a separate thread if requested */
+OutputStream* open_output_stream(const char *path, Codec codec, int append) {
+    if (!codec_available(codec)) {
+        return NULL;
+    }
+
+    OutputStream *out = (OutputStream*)mem_calloc(MEM_OUTPUT, 1, sizeof(OutputStream));
+    if (!out) {
+        fprintf(stderr, "Memory allocation failed for output stream\n");
+        exit(1);
+    }
+    out->codec = codec;
+    out->append = append;
+    out->path = mem_strdup(MEM_OUTPUT, path);
+    if (!out->path) {
+        fprintf(stderr, "Memory allocation failed for output stream\n");
+        exit(1);
+    }
+
+    /* Appended data is reported separately from what the file already held */
+    struct stat st;
+    if (append && stat(path, &st) == 0) {
+        out->base_size = (long)st.st_size;
+    }
+
+    if (codec == CODEC_NONE) {
+        out->file = fopen(path, append ? "a" : "w");
+        if (!out->file) {
+            fprintf(stderr, "Error opening file %s for writing: %s\n", path, strerror(errno));
+            mem_free(MEM_OUTPUT, out->path);
+            mem_free(MEM_OUTPUT, out);
+            return NULL;
+        }
+        return out;
+    }
+
+    int write_fd = start_pipe_thread(&out->thread, output_worker, out, &out->pipe_fd, 1);
+    if (write_fd < 0) {
+        mem_free(MEM_OUTPUT, out->path);
+        mem_free(MEM_OUTPUT, out);
+        return NULL;
+    }
+    out->has_thread = 1;
+
+    out->file = fdopen(write_fd, "w");
+    if (!out->file) {
+        fprintf(stderr, "Error opening compressed output stream: %s\n", strerror(errno));
+        exit(1);
+    }
+    setvbuf(out->file, NULL, _IOFBF, STREAM_CHUNK);
+    return out;
+}
+
+/* Finish an output file; returns the bytes stored on disk, or -1 on error */
+long close_output_stream(OutputStream *out) {
+    long size = -1;
+
+    if (!out->has_thread) {
+        struct stat st;
+        if (fflush(out->file) == 0 && fstat(fileno(out->file), &st) == 0) {
+            size = (long)st.st_size;
+        }
+        if (fclose(out->file) != 0) {
+            size = -1;
+        }
+    } else {
+        /* End of data for the compressor, then wait for it to finish */
+        int flushed = fclose(out->file) == 0;
+        pthread_join(out->thread, NULL);
+
+        struct stat st;
+        if (flushed && out->status == 0 && stat(out->path, &st) == 0) {
+            size = (long)st.st_size;
+        }
+    }
+
+    if (size < 0) {
+        fprintf(stderr, "Error writing file %s\n", out->path);
+    } else {
+        size -= out->base_size;
+    }
+
+    mem_free(MEM_OUTPUT, out->path);
+    mem_free(MEM_OUTPUT, out);
+    return size;
+}
@@ -0,0 +1,55 @@
+#ifndef STREAM_IO_H
+#define STREAM_IO_H
+
+#include <stdio.h>
+#include <pthread.h>
+
+/* Compression codecs for input and output streams */
+typedef enum {
+    CODEC_NONE,
+    CODEC_GZIP,   /* Needs HAVE_ZLIB */
+    CODEC_ZSTD    /* Needs HAVE_ZSTD */
+} Codec;
+
+/* Input stream: plain data read directly, or compressed data decoded on a
+ * worker thread and fed to the parser through a pipe */
+typedef struct InputStream {
+    FILE *file;          /* What the scanner/parser reads */
+    FILE *raw;           /* Underlying compressed source */
+    Codec codec;
+    pthread_t thread;
+    int has_thread;
+    int status;          /* Nonzero if decompression failed */
+    unsigned char magic[4];
+    size_t magic_len;    /* Bytes already consumed while sniffing */
+} InputStream;
+
+/* Output stream: plain files are written directly, compressed ones through
+ * a pipe drained by a compressor thread */
+typedef struct OutputStream {
+    FILE *file;          /* What the CSV writer writes */
+    char *path;
+    Codec codec;
+    pthread_t thread;
+    int has_thread;
+    int pipe_fd;         /* Read end drained by the compressor */
+    int status;          /* Nonzero if compression failed */
+    int append;          /* Add to an existing file (a new gzip member or zstd frame) */
+    long base_size;      /* Size of the file before appending */
+} OutputStream;
+
+/* Codec helpers */
+int parse_codec(const char *name, Codec *codec);
+const char* codec_extension(Codec codec);
+
+/* Open an input stream (NULL path reads stdin), detecting gzip/zstd by magic bytes */
+InputStream* open_input_stream(const char *path);
+int close_input_stream(InputStream *in);
+
+/* Open an output file, compressing on a separate thread if requested.
+ * With append set, data is added after the existing contents.
+ * close_output_stream returns the number of bytes it stored on disk, or -1. */
+OutputStream* open_output_stream(const char *path, Codec codec, int append);
+long close_output_stream(OutputStream *out);
+
+#endif /* STREAM_IO_H */